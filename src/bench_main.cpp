@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <comm/server.hpp>
+#include <util/JSON.hpp>
+#include <util/json_arena.hpp>
+#include <util/json_bind.hpp>
+#include <util/json_msgpack.hpp>
+#include <util/json_stream.hpp>
+#include <util/json_template.hpp>
+#include <util/json_view.hpp>
+#include <util/payload_id.hpp>
+#include <util/push_payload.hpp>
+
+static size_t s_allocs = 0;
+
+void *operator new(size_t size)
+{
+    s_allocs++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+template<typename T>
+static inline void escape(const T &value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+static double s_min_time_s = 0.2;
+static const char *s_filter = nullptr;
+
+template<typename F>
+static void bench(const std::string &name, const size_t bytes_per_op, F &&fn)
+{
+    if (s_filter != nullptr && name.find(s_filter) == std::string::npos)
+        return;
+
+    fn();
+
+    size_t iterations = 1;
+    while (true)
+    {
+        size_t allocs_before = s_allocs;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            fn();
+        double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t allocs = s_allocs - allocs_before;
+
+        if (elapsed_s >= s_min_time_s || iterations >= (size_t(1) << 30))
+        {
+            double ns_per_op = elapsed_s * 1e9 / iterations;
+            double mb_per_s = bytes_per_op ? bytes_per_op * iterations / elapsed_s / 1e6 : 0.0;
+            printf("%-36s %12.1f ns/op %10.1f MB/s %8.1f allocs/op\n", name.c_str(), ns_per_op, mb_per_s,
+                   static_cast<double>(allocs) / iterations);
+            return;
+        }
+        iterations *= elapsed_s > 0 ? std::max<size_t>(2, static_cast<size_t>(s_min_time_s / elapsed_s)) : 10;
+    }
+}
+
+static std::string make_text(const size_t size)
+{
+    static const char *const words[] = {
+            "front", "door", "unlocked", "motion", "detected", "in", "the", "hallway", "thermostat", "set",
+            "to", "21\xc2\xb0" "C", "\"living room\"", "battery", "low", "camera", "offline\n", "garage", "open"
+    };
+    std::string text;
+    size_t w = 0;
+    while (text.size() < size)
+    {
+        if (!text.empty())
+            text += ' ';
+        text += words[w++ % (sizeof(words) / sizeof(words[0]))];
+    }
+    text.resize(size);
+    return text;
+}
+
+static json::JSON make_readings(const size_t count)
+{
+    json::JSON::array readings;
+    for (size_t i = 0; i < count; i++)
+    {
+        readings.push_back(json::JSON::object{
+                {"sensor", "temp-" + std::to_string(i % 16)},
+                {"value",  18.5 + (i % 70) * 0.1},
+                {"seq",    static_cast<int>(i)},
+                {"ok",     i % 13 != 0}
+        });
+    }
+    return json::JSON::object{
+            {"device",   "home-hub"},
+            {"readings", readings}
+    };
+}
+
+struct corpus_entry
+{
+    std::string name;
+    std::string wire;
+};
+
+static std::vector<corpus_entry> make_corpus()
+{
+    std::vector<corpus_entry> corpus;
+    corpus.push_back({"ack", acknowledge(push_payload("msg", 5, "hello", false)).to_str()});
+    corpus.push_back({"idt", push_payload("idt", 5, json::JSON::object{
+            {"class", "mobile-device"},
+            {"user",  true}
+    }, false).to_str()});
+    corpus.push_back({"msg-64", push_payload("msg", 5, make_text(64), false).to_str()});
+    corpus.push_back({"msg-1k", push_payload("msg", 5, make_text(1024), false).to_str()});
+    corpus.push_back({"msg-16k", push_payload("msg", 5, make_text(16 * 1024), false).to_str()});
+    corpus.push_back({"readings-16k", push_payload("msg", 5, make_readings(200), false).to_str()});
+    return corpus;
+}
+
+int main(int argc, char const *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            s_min_time_s = atof(argv[++i]);
+        else
+            s_filter = argv[i];
+    }
+
+    std::vector<corpus_entry> corpus = make_corpus();
+
+    for (const corpus_entry &entry : corpus)
+    {
+        bench("JSON::parse/" + entry.name, entry.wire.size(), [&entry]()
+        {
+            std::string err;
+            json::JSON value = json::JSON::parse(entry.wire, err);
+            escape(value);
+        });
+    }
+
+    for (const corpus_entry &entry : corpus)
+    {
+        bench("arena_json::parse/" + entry.name, entry.wire.size(), [&entry]()
+        {
+            json::arena scratch;
+            std::string err;
+            json::arena_json value = json::arena_json::parse(scratch, entry.wire, err);
+            escape(value);
+        });
+    }
+
+    for (const corpus_entry &entry : corpus)
+    {
+        bench("stream_parser/256B-chunks/" + entry.name, entry.wire.size(), [&entry]()
+        {
+            json::sax_handler ignore;
+            json::stream_parser parser(ignore);
+            for (size_t pos = 0; pos < entry.wire.size() && !parser.done(); pos += 256)
+                parser.feed(entry.wire.data() + pos, std::min<size_t>(256, entry.wire.size() - pos));
+            escape(parser);
+        });
+    }
+
+    for (const corpus_entry &entry : corpus)
+    {
+        bench("json::view/route/" + entry.name, entry.wire.size(), [&entry]()
+        {
+            json::document doc(entry.wire);
+            json::view payload = doc.root();
+            bool idt = payload["header"].string_equals("idt");
+            int id = payload["id"].int_value();
+            int importance = payload["importance"].int_value();
+            escape(idt);
+            escape(id);
+            escape(importance);
+        });
+    }
+
+    for (const corpus_entry &entry : corpus)
+    {
+        std::string err;
+        json::JSON value = json::JSON::parse(entry.wire, err);
+        bench("JSON::dump/" + entry.name, entry.wire.size(), [&value]()
+        {
+            std::string out = value.dump();
+            escape(out);
+        });
+        bench("JSON::dump_size/" + entry.name, entry.wire.size(), [&value]()
+        {
+            size_t size = value.dump_size();
+            escape(size);
+        });
+    }
+
+    for (const corpus_entry &entry : corpus)
+    {
+        std::string err;
+        json::JSON value = json::JSON::parse(entry.wire, err);
+        std::string packed = json::msgpack::pack(value);
+        bench("msgpack::pack/" + entry.name, packed.size(), [&value]()
+        {
+            std::string out = json::msgpack::pack(value);
+            escape(out);
+        });
+        bench("msgpack::unpack/" + entry.name, packed.size(), [&packed]()
+        {
+            std::string err;
+            json::JSON value = json::msgpack::unpack(packed, err);
+            escape(value);
+        });
+        bench("msgpack::to_text/" + entry.name, packed.size(), [&packed]()
+        {
+            std::string err, text;
+            json::msgpack::to_text(packed, text, err);
+            escape(text);
+        });
+    }
+
+    for (const corpus_entry &entry : corpus)
+    {
+        std::string stream;
+        for (int i = 0; i < 32; i++)
+            stream += entry.wire;
+        bench("JSON::parse_multi/32x" + entry.name, stream.size(), [&stream]()
+        {
+            std::string err;
+            std::vector<json::JSON> values = json::JSON::parse_multi(stream, err);
+            escape(values);
+        });
+    }
+
+    std::string text = make_text(64);
+    bench("push_payload/construct", 0, [&text]()
+    {
+        push_payload payload("msg", 5, text, false);
+        escape(payload);
+    });
+
+    bench("arena_json/construct", 0, [&text]()
+    {
+        json::arena scratch;
+        json::arena_json payload = json::arena_json::object(scratch, {
+                {"id",         12345},
+                {"header",     json::arena_json(scratch, "msg")},
+                {"importance", 5},
+                {"content",    json::arena_json(scratch, text)},
+                {"timestamp",  1700000000},
+                {"notify",     false}
+        });
+        escape(payload);
+    });
+
+    for (const corpus_entry &entry : corpus)
+    {
+        bench("push_payload/from_str/" + entry.name, entry.wire.size(), [&entry]()
+        {
+            push_payload payload(entry.wire);
+            escape(payload);
+        });
+    }
+
+    push_payload incoming(corpus[2].wire);
+    bench("payload_id::next", 0, []()
+    {
+        int64_t id = payload_id::next();
+        escape(id);
+    });
+
+    nubilum_ad_hominem::dedup_filter dedup(DEDUP_WINDOW_MS, DEDUP_CAPACITY);
+    int64_t dedup_id = 0;
+    bench("dedup_filter/seen", 0, [&dedup, &dedup_id]()
+    {
+        dedup_id++;
+        bool seen = dedup.seen(42, dedup_id, static_cast<uint64_t>(dedup_id) / 1000);
+        escape(seen);
+    });
+
+    // In memory only; each call schedules one payload up to a minute out and moves the clock on by a millisecond.
+    nubilum_ad_hominem::scheduler schedule(0);
+    std::vector<nubilum_ad_hominem::scheduler::item> schedule_due;
+    int64_t schedule_now = 0;
+    bench("scheduler/add+advance", 0, [&schedule, &schedule_due, &schedule_now]()
+    {
+        schedule_now++;
+        schedule.add(schedule_now + (schedule_now * 7919) % 60000, std::string(), "{}");
+        schedule.advance(schedule_now, schedule_due);
+        schedule_due.clear();
+    });
+
+    bench("push_payload/getters", 0, [&incoming]()
+    {
+        int64_t id = incoming.get_id();
+        const std::string &header = incoming.get_header();
+        int importance = incoming.get_importance();
+        const json::JSON &content = incoming.get_content();
+        int64_t timestamp = incoming.get_timestamp();
+        bool notify = incoming.should_notify();
+        escape(id);
+        escape(header);
+        escape(importance);
+        escape(content);
+        escape(timestamp);
+        escape(notify);
+    });
+
+    // Forwarding copies the payload and changes a few fields; the content tree stays shared until patched.
+    bench("push_payload/forward", 0, [&incoming]()
+    {
+        push_payload forwarded(incoming);
+        forwarded.set_id(42);
+        forwarded.set_timestamp(1700000001);
+        escape(forwarded);
+    });
+
+    bench("push_payload/forward/patch", 0, [&incoming]()
+    {
+        push_payload forwarded(incoming);
+        forwarded.renew();
+        forwarded.mutable_content().set("forwarded", true);
+        escape(forwarded);
+    });
+
+    std::string idt = json::write(client_identity{"mobile-device", true, {}, "bench-device"});
+    bench("json::read/identity", idt.size(), [&idt]()
+    {
+        client_identity identity;
+        json::read(idt, identity);
+        escape(identity);
+    });
+
+    client_identity identity{"mobile-device", true, {}, "bench-device"};
+    bench("json::write/identity", 0, [&identity]()
+    {
+        std::string text = json::write(identity);
+        escape(text);
+    });
+
+    bench("acknowledge", 0, [&incoming]()
+    {
+        push_payload ack = acknowledge(incoming);
+        escape(ack);
+    });
+
+    bench("acknowledge/to_str", 0, [&incoming]()
+    {
+        std::string ack = acknowledge(incoming).to_str();
+        escape(ack);
+    });
+
+    json::document incoming_doc(corpus[2].wire);
+    json::view incoming_view = incoming_doc.root();
+    bench("acknowledge/arena/dump", 0, [&incoming_view]()
+    {
+        json::arena scratch;
+        std::string ack = acknowledge(incoming_view, scratch).dump();
+        escape(ack);
+    });
+
+    bench("acknowledge/template", 0, [&incoming_view]()
+    {
+        std::string ack;
+        acknowledge(incoming_view, ack, false);
+        escape(ack);
+    });
+
+    bench("acknowledge/template/msgpack", 0, [&incoming_view]()
+    {
+        std::string ack;
+        acknowledge(incoming_view, ack, true);
+        escape(ack);
+    });
+
+    // The splice alone, without the id and clock reads an ack also pays for.
+    json::message_template ack_template(json::JSON::object{
+            {"id",        json::message_template::slot("id")},
+            {"header",    "ack"},
+            {"content",   json::JSON::object{{"recv-id", json::message_template::slot("recv-id")}}},
+            {"timestamp", json::message_template::slot("timestamp")}
+    }, {"id", "recv-id", "timestamp"});
+    bench("message_template/render", 0, [&ack_template]()
+    {
+        std::string ack;
+        ack_template.render(ack, {1804289383, 846930886, 1700000000});
+        escape(ack);
+    });
+
+    return 0;
+}
@@ -1,8 +1,13 @@
 #include <iostream>
 #include <comm/client.hpp>
+#include <util/payload_id.hpp>
+#include <util/trace.hpp>
 
 int main(int argc, char const *argv[])
 {
+    trace::configure_from_env();
+    if (!payload_id::configure_from_env())
+        return 1;
     nubilum_ad_hominem::client *client = new nubilum_ad_hominem::client("127.0.0.1", "669");
     client->run();
 }
\ No newline at end of file
@@ -1,12 +1,37 @@
 #include "client.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <random>
+#include <stdexcept>
 #include <thread>
+#include <util/json_msgpack.hpp>
+#include <util/json_stream.hpp>
+#include <util/json_view.hpp>
 #include <util/push_payload.hpp>
 
 namespace nubilum_ad_hominem
 {
-    client::client(std::string str_addr, std::string str_port)
+    // NUBILUM_DEVICE_ID names the device for good; without it each client is its own device until it exits.
+    static std::string default_device_id()
+    {
+        const char *str_device = getenv("NUBILUM_DEVICE_ID");
+        if (str_device != nullptr && *str_device != '\0')
+            return str_device;
+
+        std::random_device seed;
+        unsigned long long value = (static_cast<unsigned long long>(seed()) << 32) | seed();
+        char device[17];
+        snprintf(device, sizeof(device), "%016llx", value);
+        return device;
+    }
+
+    client::client(std::string str_addr, std::string str_port) :
+            m_packed(false), m_batch_count(0), m_batch_packed(false), m_batch_max_bytes(0), m_batch_delay(0),
+            m_stopping(false), m_ack_seq(0), m_ack_window(ACK_WINDOW), m_ack_timeout(ACK_TIMEOUT_MS),
+            m_closed(false), m_ack_stopping(false)
     {
         auto log_printer = [](const std::string &msg)
         {
@@ -15,13 +40,13 @@ namespace nubilum_ad_hominem
 
         m_client = new net::tcp_client(log_printer);
         m_client->init_connect(str_addr, str_port);
-        identity = json::JSON::object{
-                {"class", "generic-client"},
-                {"user",  false}
-        };
+        identity = client_identity{"generic-client", false, {CODEC_MSGPACK}, default_device_id()};
     }
 
-    client::client()
+    client::client() :
+            m_packed(false), m_batch_count(0), m_batch_packed(false), m_batch_max_bytes(0), m_batch_delay(0),
+            m_stopping(false), m_ack_seq(0), m_ack_window(ACK_WINDOW), m_ack_timeout(ACK_TIMEOUT_MS),
+            m_closed(false), m_ack_stopping(false)
     {
         auto log_printer = [](const std::string &msg)
         {
@@ -30,46 +55,421 @@ namespace nubilum_ad_hominem
 
         m_client = new net::tcp_client(log_printer);
         m_client->init_connect("127.0.0.1", "669");
-        identity = json::JSON::object{
-                {"class", "generic-client"},
-                {"user",  false}
-        };
+        identity = client_identity{"generic-client", false, {CODEC_MSGPACK}, default_device_id()};
     }
 
     bool client::init_connect(std::string str_addr, std::string str_port)
     {
-        return m_client->disconnect() && m_client->init_connect(str_addr, str_port);
+        if (!m_client->disconnect() || !m_client->init_connect(str_addr, str_port))
+            return false;
+        std::lock_guard<std::mutex> lock(m_ack_mtx);
+        m_closed = false;
+        return true;
     }
 
     int client::run()
     {
+        build_handler_table();
         m_comm_thread = std::thread(&client::comm_thread, this);
         return 0;
     }
 
     int client::comm_thread()
     {
+        json::sax_handler framing;
+        json::stream_parser parser(framing);
+        json::msgpack::frame_scanner scan;
+        std::string buffer;
+        std::string text;
+        // A frame that spans reads keeps its place: in_frame and packed say what is being read, and fed
+        // how much of a text frame the parser has already seen, so no byte is scanned twice.
+        bool in_frame = false;
+        bool packed = false;
+        size_t fed = 0;
+        // receive() terminates what it read, so the chunk has room for one more byte.
+        char chunk[CLIENT_READ_SIZE + 1];
         while (true)
         {
-            char *cmd = (char *) malloc(256 * sizeof(char));
-
-            if (m_client->receive(cmd, 256 * sizeof(char)) <= 0)
+            int i_bytes_rcvd = m_client->receive(chunk, CLIENT_READ_SIZE);
+            if (i_bytes_rcvd <= 0)
             {
                 m_client->disconnect();
+                fail_outstanding(false);
                 return 0;
             }
-            std::string str(cmd);
-            std::cout << "RECV" << ": " << str << std::endl;
+            buffer.append(chunk, static_cast<size_t>(i_bytes_rcvd));
+
+            // Each reply is JSON text or, once the idt ack has named the codec, MessagePack. Frames are read
+            // where they lie in the buffer, which is trimmed once per read.
+            size_t consumed = 0;
+            while (true)
+            {
+                if (!in_frame)
+                {
+                    size_t start = buffer.find_first_not_of(" \t\r\n", consumed);
+                    consumed = start == std::string::npos ? buffer.size() : start;
+                    if (consumed == buffer.size())
+                        break;
+                    in_frame = true;
+                    packed = json::msgpack::is_frame_start(buffer[consumed]);
+                    fed = 0;
+                }
+
+                std::string_view rest = std::string_view(buffer).substr(consumed);
+                std::string err;
+                std::string_view frame;
+                size_t used = 0;
+                if (packed)
+                {
+                    // Handlers read JSON text, so a packed frame is rewritten once it is whole.
+                    used = json::msgpack::frame_size(rest, scan, err);
+                    text.clear();
+                    if (used && json::msgpack::to_text(rest.substr(0, used), text, err))
+                        frame = text;
+                }
+                else
+                {
+                    fed += parser.feed(rest.substr(fed));
+                    err = parser.error();
+                    if (parser.done())
+                    {
+                        used = fed;
+                        frame = rest.substr(0, used);
+                    }
+                }
+
+                if (!err.empty())
+                {
+                    std::cout << "Dropping connection: " << err << std::endl;
+                    m_client->disconnect();
+                    fail_outstanding(false);
+                    return 0;
+                }
+                if (!used)
+                    break;
+                consumed += used;
+                in_frame = false;
+                parser.reset();
+
+                json::document doc(frame);
+                json::view root = doc.root();
+                if (root.is_array())
+                {
+                    for (const json::view &payload : root.elements())
+                        dispatch(payload);
+                }
+                else
+                {
+                    dispatch(root);
+                }
+            }
+            buffer.erase(0, consumed);
+        }
+    }
+
+    // FNV-1a, started from a seed so the table can look for one under which no two headers collide.
+    static uint64_t header_hash(std::string_view name, uint64_t seed)
+    {
+        uint64_t h = 0xcbf29ce484222325ull ^ seed;
+        for (char ch : name)
+        {
+            h ^= static_cast<unsigned char>(ch);
+            h *= 0x100000001b3ull;
+        }
+        return h ^ (h >> 32);
+    }
+
+    void client::on(std::string header, message_handler handler)
+    {
+        if (m_comm_thread.joinable())
+            throw std::logic_error("client::on: handlers must be registered before run()");
+        for (auto &entry : m_handlers)
+        {
+            if (entry.first == header)
+            {
+                entry.second = std::move(handler);
+                return;
+            }
+        }
+        m_handlers.emplace_back(std::move(header), std::move(handler));
+    }
+
+    void client::on_unhandled(message_handler handler)
+    {
+        if (m_comm_thread.joinable())
+            throw std::logic_error("client::on_unhandled: handlers must be registered before run()");
+        m_unhandled = std::move(handler);
+    }
+
+    void client::build_handler_table()
+    {
+        // Twice as many slots as headers, and seeds tried until every header has a slot of its own.
+        size_t size = 1;
+        while (size < 2 * m_handlers.size())
+            size <<= 1;
+        for (m_handler_seed = 0;; m_handler_seed++)
+        {
+            m_handler_slots.assign(size, -1);
+            bool collided = false;
+            for (size_t i = 0; i < m_handlers.size() && !collided; i++)
+            {
+                int &slot = m_handler_slots[header_hash(m_handlers[i].first, m_handler_seed) & (size - 1)];
+                collided = slot >= 0;
+                slot = static_cast<int>(i);
+            }
+            if (!collided)
+                return;
         }
     }
 
+    void client::dispatch(const json::view &payload)
+    {
+        json::view header = payload["header"];
+        std::string_view name = header.string_raw();
+        std::string unescaped;
+        if (name.find('\\') != std::string_view::npos)
+        {
+            unescaped = header.string_value();
+            name = unescaped;
+        }
+
+        if (name == "ack")
+        {
+            json::view content = payload["content"];
+            if (content["codec"].string_equals(CODEC_MSGPACK))
+                m_packed = true;
+            resolve(content["recv-id"].int64_value(), true);
+        }
+
+        int slot = m_handler_slots[header_hash(name, m_handler_seed) & (m_handler_slots.size() - 1)];
+        if (slot >= 0 && m_handlers[slot].first == name)
+            m_handlers[slot].second(payload);
+        else if (m_unhandled)
+            m_unhandled(payload);
+    }
+
     void client::ident()
     {
-        m_client->send(push_payload("idt", 5, identity, false).to_str());
+        push_payload payload("idt", 5, json::to_json(identity), false);
+        send(payload);
+    }
+
+    bool client::send(push_payload &payload)
+    {
+        payload.stamp(trace::CLIENT_SEND);
+        bool packed = m_packed;
+        std::lock_guard<std::mutex> lock(m_batch_mtx);
+        if (m_batch_max_bytes == 0)
+            return m_client->send(packed ? json::msgpack::pack(json::to_json(payload)) : payload.to_str());
+
+        // A batch is all one encoding, so one started before the codec changed goes out first.
+        if (m_batch_count && packed != m_batch_packed)
+            flush_locked();
+        if (m_batch_count == 0)
+        {
+            m_batch_packed = packed;
+            m_batch_deadline = std::chrono::steady_clock::now() + m_batch_delay;
+            m_batch_cv.notify_one();
+        }
+        else if (!packed)
+        {
+            m_batch += ", ";
+        }
+
+        if (packed)
+            json::msgpack::pack(json::to_json(payload), m_batch);
+        else
+            json::write(payload, m_batch);
+        m_batch_count++;
+        return m_batch.size() < m_batch_max_bytes || flush_locked();
+    }
+
+    void client::set_batching(size_t max_bytes, std::chrono::milliseconds max_delay)
+    {
+        std::lock_guard<std::mutex> lock(m_batch_mtx);
+        m_batch_max_bytes = max_bytes;
+        m_batch_delay = max_delay;
+        if (max_bytes == 0)
+            flush_locked();
+        else if (!m_flush_thread.joinable())
+            m_flush_thread = std::thread(&client::flush_thread, this);
+    }
+
+    bool client::flush()
+    {
+        std::lock_guard<std::mutex> lock(m_batch_mtx);
+        return flush_locked();
+    }
+
+    bool client::flush_locked()
+    {
+        if (m_batch_count == 0)
+            return true;
+
+        // A batch of one goes out as a plain payload.
+        std::string frame;
+        if (m_batch_count == 1)
+        {
+            frame.swap(m_batch);
+        }
+        else if (m_batch_packed)
+        {
+            json::msgpack::pack_array_header(m_batch_count, frame);
+            frame += m_batch;
+        }
+        else
+        {
+            frame.reserve(m_batch.size() + 2);
+            frame += '[';
+            frame += m_batch;
+            frame += ']';
+        }
+        m_batch.clear();
+        m_batch_count = 0;
+        return m_client->send(frame);
+    }
+
+    int client::flush_thread()
+    {
+        std::unique_lock<std::mutex> lock(m_batch_mtx);
+        while (!m_stopping)
+        {
+            if (m_batch_count == 0)
+                m_batch_cv.wait(lock);
+            else if (std::chrono::steady_clock::now() >= m_batch_deadline)
+                flush_locked();
+            else
+                m_batch_cv.wait_until(lock, m_batch_deadline);
+        }
+        flush_locked();
+        return 0;
+    }
+
+    void client::send_async(push_payload &payload, ack_callback done)
+    {
+        int64_t id = payload.get_id();
+        {
+            std::unique_lock<std::mutex> lock(m_ack_mtx);
+            m_ack_cv.wait(lock, [this]()
+            {
+                return m_closed || m_outstanding.size() < m_ack_window;
+            });
+            if (m_closed || m_outstanding.count(id) != 0)
+            {
+                lock.unlock();
+                done(false);
+                return;
+            }
+            if (!m_expire_thread.joinable())
+                m_expire_thread = std::thread(&client::expire_thread, this);
+
+            // Registered before the send, since the ack can be back before send() returns.
+            uint64_t seq = m_ack_seq++;
+            m_outstanding.emplace(id, outstanding_send{std::move(done), seq});
+            m_deadlines.emplace(std::chrono::steady_clock::now() + m_ack_timeout, seq, id);
+            if (std::get<1>(m_deadlines.top()) == seq)
+                m_ack_cv.notify_all();
+        }
+        if (!send(payload))
+            resolve(id, false);
+    }
+
+    std::future<bool> client::send_async(push_payload &payload)
+    {
+        auto acked = std::make_shared<std::promise<bool>>();
+        std::future<bool> result = acked->get_future();
+        send_async(payload, [acked](bool ok)
+        {
+            acked->set_value(ok);
+        });
+        return result;
+    }
+
+    void client::set_ack_window(size_t max_outstanding, std::chrono::milliseconds timeout)
+    {
+        std::lock_guard<std::mutex> lock(m_ack_mtx);
+        m_ack_window = max_outstanding ? max_outstanding : 1;
+        m_ack_timeout = timeout;
+        m_ack_cv.notify_all();
+    }
+
+    void client::resolve(int64_t id, bool acked)
+    {
+        std::unique_lock<std::mutex> lock(m_ack_mtx);
+        auto found = m_outstanding.find(id);
+        if (found == m_outstanding.end())
+            return;
+        ack_callback done = std::move(found->second.done);
+        m_outstanding.erase(found);
+        m_ack_cv.notify_all();
+        lock.unlock();
+        done(acked);
+    }
+
+    void client::fail_outstanding(bool stopping)
+    {
+        std::unordered_map<int64_t, outstanding_send> failed;
+        {
+            std::lock_guard<std::mutex> lock(m_ack_mtx);
+            m_closed = true;
+            m_ack_stopping = m_ack_stopping || stopping;
+            failed.swap(m_outstanding);
+            m_deadlines = decltype(m_deadlines)();
+            m_ack_cv.notify_all();
+        }
+        for (auto &entry : failed)
+            entry.second.done(false);
+    }
+
+    int client::expire_thread()
+    {
+        std::unique_lock<std::mutex> lock(m_ack_mtx);
+        while (!m_ack_stopping)
+        {
+            // Deadlines of payloads already acked are dropped as they reach the top.
+            while (!m_deadlines.empty())
+            {
+                auto found = m_outstanding.find(std::get<2>(m_deadlines.top()));
+                if (found != m_outstanding.end() && found->second.seq == std::get<1>(m_deadlines.top()))
+                    break;
+                m_deadlines.pop();
+            }
+            if (m_deadlines.empty())
+            {
+                m_ack_cv.wait(lock);
+                continue;
+            }
+            ack_deadline next = m_deadlines.top();
+            if (std::chrono::steady_clock::now() < std::get<0>(next))
+            {
+                m_ack_cv.wait_until(lock, std::get<0>(next));
+                continue;
+            }
+
+            m_deadlines.pop();
+            auto found = m_outstanding.find(std::get<2>(next));
+            ack_callback done = std::move(found->second.done);
+            m_outstanding.erase(found);
+            m_ack_cv.notify_all();
+            lock.unlock();
+            done(false);
+            lock.lock();
+        }
+        return 0;
     }
 
     client::~client()
     {
+        {
+            std::lock_guard<std::mutex> lock(m_batch_mtx);
+            m_stopping = true;
+        }
+        m_batch_cv.notify_one();
+        if (m_flush_thread.joinable())
+            m_flush_thread.join();
+        fail_outstanding(true);
+        if (m_expire_thread.joinable())
+            m_expire_thread.join();
         if (m_comm_thread.joinable())
             m_comm_thread.join();
     }
@@ -1,16 +1,44 @@
 #ifndef COMM_CLIENT_HPP
 #define COMM_CLIENT_HPP
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <net/tcp_client.hpp>
 #include <util/JSON.hpp>
+#include <util/json_view.hpp>
+#include <util/push_payload.hpp>
+
+#define BATCH_MAX_BYTES (16 * 1024)
+#define BATCH_MAX_DELAY_MS 5
+#define ACK_WINDOW 256
+#define ACK_TIMEOUT_MS 5000
+#define CLIENT_READ_SIZE 4096
 
 namespace nubilum_ad_hominem
 {
     class client
     {
     public:
+        // Told once per send_async whether the server acked the payload. false means the timeout passed or the
+        // connection dropped first. Runs on the receive thread or the timeout thread, so it should not block.
+        using ack_callback = std::function<void(bool acked)>;
+
+        // Called on the receive thread for each payload, as a view of the frame it came in. The view and
+        // anything taken from it are valid only during the call. Packed frames are rewritten as text first.
+        using message_handler = std::function<void(const json::view &payload)>;
+
         client();
 
         client(std::string str_addr, std::string str_port);
@@ -25,10 +53,93 @@ namespace nubilum_ad_hominem
 
         void ident();
 
+        bool send(push_payload &payload);
+
+        // Holds payloads back for up to max_delay after the first one, or until about max_bytes are
+        // waiting, and sends them together as one array frame. max_bytes 0 sends each payload on its own.
+        void set_batching(size_t max_bytes, std::chrono::milliseconds max_delay);
+
+        bool flush();
+
+        // Sends without waiting for the ack, so many payloads can be in flight per round trip; the ack is
+        // matched to the payload by its recv-id. Blocks while the window of unacked payloads is full, so it
+        // must not be called from an ack_callback. A payload whose id is still waiting for its ack is not sent
+        // again; done is told false at once.
+        void send_async(push_payload &payload, ack_callback done);
+
+        std::future<bool> send_async(push_payload &payload);
+
+        // The timeout applies to payloads sent from then on.
+        void set_ack_window(size_t max_outstanding, std::chrono::milliseconds timeout);
+
+        // Handlers must be registered before run(), which builds a perfect hash of their headers so the receive
+        // thread finds one with a single probe and no lock; registering after run() throws std::logic_error.
+        // A second handler for a header replaces the first. Acks are matched to send_async before their
+        // handler runs.
+        void on(std::string header, message_handler handler);
+
+        // For payloads whose header has no handler. Without one they are dropped.
+        void on_unhandled(message_handler handler);
+
     protected:
         net::tcp_client *m_client;
         std::thread m_comm_thread;
-        json::JSON identity;
+        client_identity identity;
+        std::atomic<bool> m_packed;
+
+    private:
+        int flush_thread();
+
+        bool flush_locked();
+
+        void build_handler_table();
+
+        void dispatch(const json::view &payload);
+
+        int expire_thread();
+
+        void resolve(int64_t id, bool acked);
+
+        // Fails everything still waiting for an ack, as when the connection drops.
+        void fail_outstanding(bool stopping);
+
+        std::mutex m_batch_mtx;
+        std::condition_variable m_batch_cv;
+        std::thread m_flush_thread;
+        std::string m_batch;
+        size_t m_batch_count;
+        bool m_batch_packed;
+        size_t m_batch_max_bytes;
+        std::chrono::milliseconds m_batch_delay;
+        std::chrono::steady_clock::time_point m_batch_deadline;
+        bool m_stopping;
+
+        std::mutex m_ack_mtx;
+        std::condition_variable m_ack_cv;
+        std::thread m_expire_thread;
+        struct outstanding_send
+        {
+            ack_callback done;
+            uint64_t seq;
+        };
+
+        // Deadline, send sequence and id, earliest deadline on top. The sequence tells a deadline apart from
+        // one left behind by an earlier payload with the same id.
+        using ack_deadline = std::tuple<std::chrono::steady_clock::time_point, uint64_t, int64_t>;
+
+        std::unordered_map<int64_t, outstanding_send> m_outstanding;
+        std::priority_queue<ack_deadline, std::vector<ack_deadline>, std::greater<ack_deadline>> m_deadlines;
+        uint64_t m_ack_seq;
+        size_t m_ack_window;
+        std::chrono::milliseconds m_ack_timeout;
+        bool m_closed;
+        bool m_ack_stopping;
+
+        std::vector<std::pair<std::string, message_handler>> m_handlers;
+        message_handler m_unhandled;
+        // Index into m_handlers for each hash slot, or -1.
+        std::vector<int> m_handler_slots;
+        uint64_t m_handler_seed;
     };
 }
 
@@ -0,0 +1,98 @@
+#include "dedup.hpp"
+
+#include <algorithm>
+
+namespace nubilum_ad_hominem
+{
+    static const int s_probes = 4;
+
+    static uint64_t mix(uint64_t sender, int64_t id)
+    {
+        uint64_t h = sender ^ (static_cast<uint64_t>(id) * 0x9e3779b97f4a7c15ull);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    dedup_filter::dedup_filter(uint64_t window_ms, size_t capacity) :
+            m_window_ms(window_ms), m_capacity(capacity), m_current(0)
+    {
+        // About 16 bits per pair keeps false positives near 0.25% with four probes.
+        size_t words = (capacity * 16 + 63) / 64;
+        size_t slots = 2;
+        while (slots < capacity * 2)
+            slots *= 2;
+        for (generation &gen : m_generations)
+        {
+            gen.bits.assign(words ? words : 1, 0);
+            gen.keys.assign(slots, key{0, 0, false});
+            gen.count = 0;
+            gen.started_ms = 0;
+        }
+    }
+
+    bool dedup_filter::contains(const generation &gen, const key &k, uint64_t hash) const
+    {
+        uint64_t size = gen.bits.size() * 64;
+        uint64_t step = (hash >> 32) | 1;
+        for (int i = 0; i < s_probes; i++)
+        {
+            uint64_t bit = (hash + i * step) % size;
+            if (!(gen.bits[bit / 64] & (uint64_t(1) << (bit % 64))))
+                return false;
+        }
+
+        size_t mask = gen.keys.size() - 1;
+        for (size_t slot = hash & mask; gen.keys[slot].used; slot = (slot + 1) & mask)
+        {
+            if (gen.keys[slot].sender == k.sender && gen.keys[slot].id == k.id)
+                return true;
+        }
+        return false;
+    }
+
+    void dedup_filter::add(generation &gen, const key &k, uint64_t hash)
+    {
+        uint64_t size = gen.bits.size() * 64;
+        uint64_t step = (hash >> 32) | 1;
+        for (int i = 0; i < s_probes; i++)
+        {
+            uint64_t bit = (hash + i * step) % size;
+            gen.bits[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+
+        size_t mask = gen.keys.size() - 1;
+        size_t slot = hash & mask;
+        while (gen.keys[slot].used)
+            slot = (slot + 1) & mask;
+        gen.keys[slot] = key{k.sender, k.id, true};
+        gen.count++;
+    }
+
+    bool dedup_filter::seen(uint64_t sender, int64_t id, uint64_t now_ms)
+    {
+        key k{sender, id, true};
+        uint64_t hash = mix(sender, id);
+        for (const generation &gen : m_generations)
+        {
+            if (contains(gen, k, hash))
+                return true;
+        }
+
+        generation *current = &m_generations[m_current];
+        if (current->count >= m_capacity || now_ms - current->started_ms >= m_window_ms)
+        {
+            m_current ^= 1;
+            current = &m_generations[m_current];
+            std::fill(current->bits.begin(), current->bits.end(), 0);
+            std::fill(current->keys.begin(), current->keys.end(), key{0, 0, false});
+            current->count = 0;
+            current->started_ms = now_ms;
+        }
+        add(*current, k, hash);
+        return false;
+    }
+}
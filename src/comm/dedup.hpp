@@ -0,0 +1,52 @@
+#ifndef COMM_DEDUP_HPP
+#define COMM_DEDUP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nubilum_ad_hominem
+{
+    // Remembers which (sender, id) pairs have been seen, for at least window_ms unless more than capacity
+    // arrive within one window. Two generations take turns: each lookup checks both, new pairs go into the
+    // current one, and the older one is emptied when the current one is full or a window old. A Bloom filter
+    // per generation answers most first sightings without touching the exact table behind it. Memory is
+    // fixed at construction.
+    class dedup_filter
+    {
+    public:
+        dedup_filter(uint64_t window_ms, size_t capacity);
+
+        // True if the pair was seen before; otherwise records it.
+        bool seen(uint64_t sender, int64_t id, uint64_t now_ms);
+
+    private:
+        struct key
+        {
+            uint64_t sender;
+            int64_t id;
+
+            bool used;
+        };
+
+        // keys is open addressed with linear probing and kept at most half full.
+        struct generation
+        {
+            std::vector<uint64_t> bits;
+            std::vector<key> keys;
+            size_t count;
+            uint64_t started_ms;
+        };
+
+        bool contains(const generation &gen, const key &k, uint64_t hash) const;
+
+        void add(generation &gen, const key &k, uint64_t hash);
+
+        uint64_t m_window_ms;
+        size_t m_capacity;
+        generation m_generations[2];
+        size_t m_current;
+    };
+}
+
+#endif //COMM_DEDUP_HPP
@@ -0,0 +1,43 @@
+#include "delivery_queue.hpp"
+
+#include <iterator>
+
+namespace nubilum_ad_hominem
+{
+    delivery_queue::delivery_queue(size_t capacity, size_t max_bytes) :
+            m_capacity(capacity), m_max_bytes(max_bytes), m_bytes(0)
+    {}
+
+    void delivery_queue::push(std::string_view collapse_key, std::string text)
+    {
+        if (!collapse_key.empty())
+        {
+            auto found = m_index.find(std::string(collapse_key));
+            if (found != m_index.end())
+            {
+                m_bytes -= found->second->text.size();
+                m_entries.erase(found->second);
+                m_index.erase(found);
+            }
+        }
+        if (m_capacity == 0 || text.size() > m_max_bytes)
+            return;
+        while (m_entries.size() == m_capacity || m_bytes + text.size() > m_max_bytes)
+            pop();
+
+        m_bytes += text.size();
+        m_entries.push_back(entry{std::string(collapse_key), std::move(text)});
+        if (!collapse_key.empty())
+            m_index.emplace(m_entries.back().collapse_key, std::prev(m_entries.end()));
+    }
+
+    delivery_queue::entry delivery_queue::pop()
+    {
+        entry front = std::move(m_entries.front());
+        m_entries.pop_front();
+        m_bytes -= front.text.size();
+        if (!front.collapse_key.empty())
+            m_index.erase(front.collapse_key);
+        return front;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef COMM_DELIVERY_QUEUE_HPP
+#define COMM_DELIVERY_QUEUE_HPP
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace nubilum_ad_hominem
+{
+    // Payloads waiting for one recipient, oldest first. A payload with a collapse key replaces a pending one
+    // with the same key, so the queue grows with the number of distinct keys rather than the update rate.
+    // Past capacity payloads, or max_bytes of payload text, the oldest payloads are dropped.
+    class delivery_queue
+    {
+    public:
+        struct entry
+        {
+            std::string collapse_key;
+            std::string text;
+        };
+
+        delivery_queue(size_t capacity, size_t max_bytes);
+
+        // An empty collapse_key never replaces anything. The replacement goes to the back, as the newest.
+        void push(std::string_view collapse_key, std::string text);
+
+        entry pop();
+
+        bool empty() const
+        {
+            return m_entries.empty();
+        }
+
+        size_t size() const
+        {
+            return m_entries.size();
+        }
+
+    private:
+        std::list<entry> m_entries;
+        std::unordered_map<std::string, std::list<entry>::iterator> m_index;
+        size_t m_capacity;
+        size_t m_max_bytes;
+        size_t m_bytes;
+    };
+}
+
+#endif //COMM_DELIVERY_QUEUE_HPP
@@ -0,0 +1,279 @@
+#include "scheduler.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace nubilum_ad_hominem
+{
+    namespace
+    {
+        const char s_magic[8] = {'N', 'U', 'B', 'S', 'C', 'H', 'D', '1'};
+
+        enum record_kind : uint32_t
+        {
+            RECORD_ADD = 1,
+            RECORD_DONE = 2
+        };
+
+        // Host byte order, like the trace file; the log is only read back by the server that wrote it.
+        struct record_header
+        {
+            uint32_t kind;
+            uint32_t key_size;
+            uint64_t seq;
+            int64_t due_ms;
+            uint32_t text_size;
+            uint32_t reserved;
+        };
+
+        void append_record(std::string &out, const record_header &header, const scheduler::item *it)
+        {
+            out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+            if (it != nullptr)
+            {
+                out += it->collapse_key;
+                out += it->text;
+            }
+        }
+
+        bool read_bytes(FILE *in, std::string &out, size_t size)
+        {
+            out.resize(size);
+            return size == 0 || fread(&out[0], 1, size, in) == size;
+        }
+    }
+
+    scheduler::scheduler(int64_t now_ms) : m_tick(now_ms / tick_ms), m_size(0), m_next_seq(1), m_log(nullptr),
+                                           m_log_records(0)
+    {}
+
+    scheduler::~scheduler()
+    {
+        if (m_log != nullptr)
+            fclose(m_log);
+    }
+
+    bool scheduler::open(const std::string &path)
+    {
+        m_path = path;
+
+        // A record cut short by a crash ends the replay; everything before it is kept.
+        FILE *in = fopen(path.c_str(), "rb");
+        if (in != nullptr)
+        {
+            char magic[sizeof(s_magic)];
+            if (fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, s_magic, sizeof(magic)) == 0)
+            {
+                std::unordered_map<uint64_t, item> live;
+                record_header header;
+                while (fread(&header, sizeof(header), 1, in) == 1)
+                {
+                    if (header.kind == RECORD_DONE)
+                    {
+                        live.erase(header.seq);
+                        continue;
+                    }
+                    item it{header.seq, header.due_ms, std::string(), std::string()};
+                    if (header.kind != RECORD_ADD || !read_bytes(in, it.collapse_key, header.key_size) ||
+                        !read_bytes(in, it.text, header.text_size))
+                        break;
+                    live[it.seq] = std::move(it);
+                }
+                for (auto &entry : live)
+                {
+                    if (entry.first >= m_next_seq)
+                        m_next_seq = entry.first + 1;
+                    file(std::move(entry.second));
+                    m_size++;
+                }
+            }
+            fclose(in);
+
+            // Starting from the live items alone drops whatever the old log had already released; if that
+            // fails the old log is still whole and is appended to instead.
+            if (!compact())
+                m_log = fopen(path.c_str(), "ab");
+            return m_log != nullptr;
+        }
+
+        // Nothing to replay: the log is created by the first add, so a server that never schedules leaves
+        // no file behind.
+        return true;
+    }
+
+    void scheduler::add(int64_t due_ms, std::string collapse_key, std::string text)
+    {
+        item it{m_next_seq++, due_ms, std::move(collapse_key), std::move(text)};
+        log_add(it);
+        file(std::move(it));
+        m_size++;
+    }
+
+    void scheduler::advance(int64_t now_ms, std::vector<item> &due)
+    {
+        int64_t target = now_ms / tick_ms;
+        if (m_size == 0 && target > m_tick)
+            m_tick = target;
+
+        size_t from = due.size();
+        while (m_tick < target && m_size > 0)
+        {
+            m_tick++;
+
+            // When a level comes round to a new slot, its items are spread over the levels below.
+            for (int level = 1; level < s_levels; level++)
+            {
+                int shift = level * s_slot_bits;
+                if ((m_tick & ((int64_t(1) << shift) - 1)) != 0)
+                    break;
+                cascade(m_wheel[level][(m_tick >> shift) & (s_slots - 1)]);
+                if (level == s_levels - 1)
+                    cascade(m_overflow);
+            }
+
+            std::vector<item> &slot = m_wheel[0][m_tick & (s_slots - 1)];
+            for (item &it : slot)
+                due.push_back(std::move(it));
+            m_size -= slot.size();
+            slot.clear();
+        }
+        if (m_size == 0 && target > m_tick)
+            m_tick = target;
+
+        if (due.size() > from)
+            log_done(due, from);
+    }
+
+    void scheduler::file(item &&it)
+    {
+        // Anything already due goes out on the next tick.
+        int64_t due_tick = it.due_ms / tick_ms;
+        if (due_tick <= m_tick)
+            due_tick = m_tick + 1;
+
+        int64_t delta = due_tick - m_tick;
+        for (int level = 0; level < s_levels; level++)
+        {
+            int shift = level * s_slot_bits;
+            if (delta < (int64_t(1) << (shift + s_slot_bits)))
+            {
+                m_wheel[level][(due_tick >> shift) & (s_slots - 1)].push_back(std::move(it));
+                return;
+            }
+        }
+        m_overflow.push_back(std::move(it));
+    }
+
+    void scheduler::cascade(std::vector<item> &slot)
+    {
+        if (slot.empty())
+            return;
+        std::vector<item> items;
+        items.swap(slot);
+        for (item &it : items)
+            file(std::move(it));
+    }
+
+    void scheduler::log_add(const item &it)
+    {
+        if (m_log == nullptr && !m_path.empty())
+        {
+            m_log = fopen(m_path.c_str(), "ab");
+            if (m_log == nullptr)
+            {
+                std::cerr << "Cannot create " << m_path << " (" << strerror(errno)
+                          << "); scheduled payloads will not survive a restart." << std::endl;
+                m_path.clear();
+                return;
+            }
+            fseek(m_log, 0, SEEK_END);
+            if (ftell(m_log) == 0)
+                fwrite(s_magic, 1, sizeof(s_magic), m_log);
+        }
+        if (m_log == nullptr)
+            return;
+        std::string out;
+        record_header header{RECORD_ADD, static_cast<uint32_t>(it.collapse_key.size()), it.seq, it.due_ms,
+                             static_cast<uint32_t>(it.text.size()), 0};
+        append_record(out, header, &it);
+        fwrite(out.data(), 1, out.size(), m_log);
+        fflush(m_log);
+        m_log_records++;
+    }
+
+    void scheduler::log_done(const std::vector<item> &released, size_t from)
+    {
+        if (m_log == nullptr)
+            return;
+        // A compacted log holds only live items, so the batch needs no record there; a failed compaction leaves
+        // the old log in use and the batch is recorded in it.
+        if (m_log_records > 2 * m_size + 4096 && compact())
+            return;
+
+        // One write for the whole batch.
+        std::string out;
+        for (size_t i = from; i < released.size(); i++)
+        {
+            record_header header{RECORD_DONE, 0, released[i].seq, released[i].due_ms, 0, 0};
+            append_record(out, header, nullptr);
+        }
+        fwrite(out.data(), 1, out.size(), m_log);
+        fflush(m_log);
+        m_log_records += released.size() - from;
+    }
+
+    bool scheduler::compact()
+    {
+        if (m_path.empty())
+            return false;
+
+        // Written beside the log and renamed over it, so a crash leaves one whole log or the other. The handle
+        // it was written through becomes the log, so once the rename succeeds nothing has to be reopened and
+        // the old log, now unlinked, is never written again; until then the old log stays in use.
+        std::string tmp_path = m_path + ".tmp";
+        FILE *out = fopen(tmp_path.c_str(), "wb");
+        if (out == nullptr)
+        {
+            std::cerr << "Cannot compact " << m_path << ": " << tmp_path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        std::string buffer(s_magic, sizeof(s_magic));
+        auto write_slot = [&](const std::vector<item> &slot)
+        {
+            for (const item &it : slot)
+            {
+                record_header header{RECORD_ADD, static_cast<uint32_t>(it.collapse_key.size()), it.seq, it.due_ms,
+                                     static_cast<uint32_t>(it.text.size()), 0};
+                append_record(buffer, header, &it);
+                if (buffer.size() > 1024 * 1024)
+                {
+                    fwrite(buffer.data(), 1, buffer.size(), out);
+                    buffer.clear();
+                }
+            }
+        };
+        for (auto &level : m_wheel)
+        {
+            for (const std::vector<item> &slot : level)
+                write_slot(slot);
+        }
+        write_slot(m_overflow);
+        bool written = fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+        written = fflush(out) == 0 && written;
+        if (!written || rename(tmp_path.c_str(), m_path.c_str()) != 0)
+        {
+            std::cerr << "Cannot compact " << m_path << ": " << strerror(errno) << std::endl;
+            fclose(out);
+            remove(tmp_path.c_str());
+            return false;
+        }
+
+        if (m_log != nullptr)
+            fclose(m_log);
+        m_log = out;
+        m_log_records = m_size;
+        return true;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef COMM_SCHEDULER_HPP
+#define COMM_SCHEDULER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace nubilum_ad_hominem
+{
+    // Holds payloads until a wall-clock time, in a hierarchical timing wheel: four levels of 256 slots over
+    // 10 ms ticks, so adding is O(1) and each tick only looks at the slots it reaches. Items further out than
+    // the wheel spans (about 1.4 years) wait in an overflow list that is re-filed every few days of ticks.
+    //
+    // With a backing file every add and release is appended to a log, and open() replays it, so payloads
+    // survive a restart; anything already due comes out on the first advance(). The log is rewritten with
+    // only the live items once released ones dominate it.
+    class scheduler
+    {
+    public:
+        struct item
+        {
+            uint64_t seq;
+            int64_t due_ms;
+            std::string collapse_key;
+            std::string text;
+        };
+
+        explicit scheduler(int64_t now_ms);
+
+        ~scheduler();
+
+        scheduler(const scheduler &) = delete;
+
+        scheduler &operator=(const scheduler &) = delete;
+
+        // Replays path if it exists and logs to it from then on; a missing log is created by the first add.
+        // Returns false if an existing log cannot be written.
+        bool open(const std::string &path);
+
+        void add(int64_t due_ms, std::string collapse_key, std::string text);
+
+        // Appends everything due by now_ms to due.
+        void advance(int64_t now_ms, std::vector<item> &due);
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        static const int64_t tick_ms = 10;
+
+    private:
+        static const int s_levels = 4;
+        static const int s_slot_bits = 8;
+        static const size_t s_slots = 1 << s_slot_bits;
+
+        void file(item &&it);
+
+        void cascade(std::vector<item> &slot);
+
+        void log_add(const item &it);
+
+        void log_done(const std::vector<item> &released, size_t from);
+
+        // Rewrites the log with only the live items and logs to the rewritten file from then on. Returns false,
+        // with the old log still in use, on failure.
+        bool compact();
+
+        std::vector<item> m_wheel[s_levels][s_slots];
+        std::vector<item> m_overflow;
+        int64_t m_tick;
+        size_t m_size;
+        uint64_t m_next_seq;
+
+        std::string m_path;
+        FILE *m_log;
+        size_t m_log_records;
+    };
+}
+
+#endif //COMM_SCHEDULER_HPP
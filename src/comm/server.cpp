@@ -1,14 +1,24 @@
 #include "server.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <thread>
 #include <sys/select.h>
 
+#include <util/json_bind.hpp>
+#include <util/json_msgpack.hpp>
+#include <util/json_view.hpp>
 #include <util/push_payload.hpp>
+#include <util/trace.hpp>
 
 namespace nubilum_ad_hominem
 {
-    server::server(std::string str_port)
+    server::server(std::string str_port) : m_dedup(DEDUP_WINDOW_MS, DEDUP_CAPACITY), m_anonymous_sender(1),
+                                           m_scheduler(static_cast<int64_t>(trace::wall_ns() / 1000000)),
+                                           m_offline_clock(0)
     {
         auto log_printer = [](const std::string &strLogMsg)
         {
@@ -20,14 +30,53 @@ namespace nubilum_ad_hominem
             m_client = 0;
         }
         m_server->start_listen(m_client_socket);
-        for (int &m_client : m_clients)
+        add_client(m_client_socket);
+
+        const char *str_path = getenv("NUBILUM_SCHEDULE_FILE");
+        std::string schedule_path = str_path != nullptr ? str_path : SCHEDULE_FILE;
+        if (!schedule_path.empty())
+        {
+            if (!m_scheduler.open(schedule_path))
+                std::cout << "Cannot write " << schedule_path << "; scheduled payloads will not survive a restart."
+                          << std::endl;
+            else if (!m_scheduler.empty())
+                std::cout << "Restored " << m_scheduler.size() << " scheduled payloads." << std::endl;
+        }
+    }
+
+    void server::add_client(net::node::socket_fd sd)
+    {
+        for (int i = 0; i < MAX_CLIENTS; i++)
         {
-            if (m_client == 0)
+            if (m_clients[i] == 0)
             {
-                m_client = m_client_socket;
-                break;
+                m_clients[i] = sd;
+                m_connections[i].reset(new connection());
+                m_connections[i]->sender = m_anonymous_sender++;
+                return;
             }
         }
+        // No slot to watch it from, so it would never be read or closed.
+        std::cout << "Refusing a connection: all " << MAX_CLIENTS << " client slots are in use." << std::endl;
+        m_server->disconnect(sd);
+    }
+
+    void server::remove_client(int i)
+    {
+        // Whatever a user client had not been sent yet waits in its offline store.
+        connection &conn = *m_connections[i];
+        if (conn.user && conn.has_device)
+        {
+            delivery_queue &stored = offline_store_for(conn.sender);
+            while (!conn.forward.empty())
+            {
+                delivery_queue::entry item = conn.forward.pop();
+                stored.push(item.collapse_key, std::move(item.text));
+            }
+        }
+        m_server->disconnect(m_clients[i]);
+        m_clients[i] = 0;
+        m_connections[i].reset();
     }
 
     int server::run()
@@ -44,7 +93,7 @@ namespace nubilum_ad_hominem
             FD_ZERO(&m_readfds);
             FD_SET(m_server->m_listen_socket, &m_readfds);
             net::node::socket_fd max_sd = m_server->m_listen_socket;
-            for (int i = 0; i < 10; i++)
+            for (int i = 0; i < MAX_CLIENTS; i++)
             {
                 net::node::socket_fd sd = m_clients[i];
                 if (sd > 0)
@@ -53,7 +102,9 @@ namespace nubilum_ad_hominem
                     max_sd = sd;
             }
 
-            int sk = select(max_sd + 1, &m_readfds, nullptr, nullptr, nullptr);
+            // While payloads are scheduled the loop wakes every tick to release the ones that came due.
+            struct timeval tick = {0, scheduler::tick_ms * 1000};
+            int sk = select(max_sd + 1, &m_readfds, nullptr, nullptr, m_scheduler.empty() ? nullptr : &tick);
 
             if ((sk < 0) && (errno != EINTR))
             {
@@ -63,61 +114,295 @@ namespace nubilum_ad_hominem
             if (FD_ISSET(m_server->m_listen_socket, &m_readfds))
             {
                 m_server->start_listen(m_client_socket);
-                for (int &m_client : m_clients)
-                {
-                    if (m_client == 0)
-                    {
-                        m_client = m_client_socket;
-                        break;
-                    }
-                }
+                add_client(m_client_socket);
             }
-            for (int &m_client : m_clients)
+            for (int i = 0; i < MAX_CLIENTS; i++)
             {
-                int sd = m_client;
+                int sd = m_clients[i];
                 if (FD_ISSET(sd, &m_readfds))
                 {
-                    char *cmd = (char *) malloc(256 * sizeof(char));
+                    char cmd[READ_SIZE + 1];
 
-                    if (m_server->receive(sd, cmd, 256 * sizeof(char)) <= 0)
+                    int i_bytes_rcvd = m_server->receive(sd, cmd, READ_SIZE);
+                    if (i_bytes_rcvd <= 0)
                     {
-                        m_server->disconnect(sd);
-                        m_client = 0;
+                        remove_client(i);
                         continue;
                     }
-                    std::string str(cmd);
-                    if (str == "!quitserver")
+                    uint64_t recv_mono_ns = trace::mono_ns();
+                    uint64_t recv_wall_ns = trace::wall_ns();
+                    connection &conn = *m_connections[i];
+                    if (!conn.parser.started() && std::string(cmd) == "!quitserver")
                     {
                         m_server->disconnect(m_client_socket);
                         return 0;
                     }
-                    else
+
+                    // A read may stop inside a payload or carry several; each one is dispatched once complete.
+                    const char *data = cmd;
+                    size_t size = static_cast<size_t>(i_bytes_rcvd);
+                    while (size > 0)
                     {
-                        push_payload payload(str);
-                        std::cout << "RECV: " << payload.to_str() << std::endl;
+                        if (!conn.parser.started() && !conn.packed)
+                        {
+                            if (isspace(static_cast<unsigned char>(*data)))
+                            {
+                                data++;
+                                size--;
+                                continue;
+                            }
+                            conn.packed = json::msgpack::is_frame_start(*data);
+                        }
 
-                        m_server->send(sd, acknowledge(payload).to_str());
+                        std::string err;
+                        bool complete;
+                        if (conn.packed)
+                        {
+                            size_t before = conn.frame.size();
+                            conn.frame.append(data, size);
+                            size_t frame_size = json::msgpack::frame_size(conn.frame, conn.scan, err);
+                            size_t used = frame_size ? frame_size - before : size;
+                            conn.frame.resize(before + used);
+                            data += used;
+                            size -= used;
+                            complete = frame_size != 0;
+                        }
+                        else
+                        {
+                            size_t used = conn.parser.feed(data, size);
+                            conn.frame.append(data, used);
+                            data += used;
+                            size -= used;
+                            err = conn.parser.error();
+                            complete = conn.parser.done();
+                        }
+
+                        if (complete && conn.packed)
+                        {
+                            // Routing reads JSON text, so a packed payload is rewritten once it is whole.
+                            std::string text;
+                            if (json::msgpack::to_text(conn.frame, text, err))
+                                conn.frame.swap(text);
+                        }
+
+                        if (!err.empty() || conn.frame.size() > MAX_FRAME_SIZE)
+                        {
+                            std::cout << "Dropping client: " << (!err.empty() ? err : "payload too large")
+                                      << std::endl;
+                            flush(sd, conn);
+                            remove_client(i);
+                            break;
+                        }
 
-                        if (payload.get_header() == "idt")
+                        if (complete)
                         {
-                            std::cout << "Incoming client identification." << std::endl;
-                            json::JSON identity = payload.get_content();
-                            std::cout << "Identity: " << identity.dump() << std::endl;
-                            if (identity["user"].bool_value())
+                            // A batch is an array of payloads, each handled as if it had come alone.
+                            json::document doc(conn.frame);
+                            json::view root = doc.root();
+                            if (root.is_array())
                             {
-                                std::cout << "User client identified." << std::endl;
-                                this->m_user_clients.push_back(m_client);
-                                std::cout << "Added user client to user client registry." << std::endl;
+                                for (const json::view &payload : root.elements())
+                                    dispatch(conn, payload, recv_mono_ns, recv_wall_ns);
                             }
                             else
                             {
-                                std::cout << "Home client identified." << std::endl;
+                                dispatch(conn, root, recv_mono_ns, recv_wall_ns);
                             }
+                            conn.frame.clear();
+                            conn.parser.reset();
+                            conn.packed = false;
                         }
                     }
                 }
             }
+
+            release_scheduled();
+
+            // Replies and forwarded payloads from this round go out together, one writev per client.
+            for (int i = 0; i < MAX_CLIENTS; i++)
+            {
+                if (m_connections[i])
+                    flush(m_clients[i], *m_connections[i]);
+            }
+        }
+    }
+
+    void server::dispatch(connection &conn, const json::view &payload, uint64_t recv_mono_ns,
+                          uint64_t recv_wall_ns)
+    {
+        payload_trace hops(payload, recv_mono_ns, recv_wall_ns);
+
+        // A retransmit is answered again so the sender stops, but goes no further. The frame has been indexed
+        // by now; what the check saves is decoding the content and handing the payload on. Payloads without
+        // an integer id cannot be told apart, so none of them counts as a retransmit.
+        bool idt = payload["header"].string_equals("idt");
+        json::view id = payload["id"];
+        bool duplicate = !idt && id.is_integer() && m_dedup.seen(conn.sender, id.int64_value(),
+                                                                 recv_mono_ns / 1000000);
+        if (!duplicate)
+            std::cout << "RECV: " << payload.raw() << std::endl;
+
+        client_identity identity;
+        std::string_view codec;
+        if (idt)
+        {
+            json::read(std::string(payload["content"].raw()), identity);
+            if (!identity.device.empty())
+            {
+                conn.sender = std::hash<std::string>()(identity.device);
+                conn.has_device = true;
+            }
+            for (const std::string &name : identity.codecs)
+            {
+                if (name == CODEC_MSGPACK)
+                    codec = CODEC_MSGPACK;
+            }
+        }
+
+        hops.stamp(trace::DISPATCH);
+        std::string &ack = conn.next_outbound();
+        if (codec.empty())
+        {
+            acknowledge(payload, ack, conn.packed_replies);
+        }
+        else
+        {
+            json::arena scratch;
+            json::arena_json reply = acknowledge(payload, scratch, codec);
+            if (conn.packed_replies)
+                json::msgpack::pack(reply, ack);
+            else
+                reply.dump(ack);
+        }
+        conn.outbound_hops.push_back(hops);
+        hops.stamp(trace::ENQUEUE);
+
+        if (duplicate)
+            std::cout << "Dropped duplicate payload " << payload["id"].int64_value() << "." << std::endl;
+        else if (!idt && !conn.user)
+        {
+            // Every user queue holds payloads from every home, so a key only replaces payloads from the same
+            // sender; two homes may both call an update "thermostat".
+            std::string collapse_key = payload["collapse"].string_value();
+            if (!collapse_key.empty())
+                collapse_key = std::to_string(conn.sender) + ":" + collapse_key;
+            int64_t deliver_at = payload["deliver-at"].int64_value();
+            if (deliver_at > static_cast<int64_t>(recv_wall_ns / 1000000))
+                m_scheduler.add(deliver_at, std::move(collapse_key), std::string(payload.raw()));
+            else
+                fan_out(collapse_key, payload.raw());
+        }
+        if (idt)
+        {
+            // The ack that names the codec is still text; everything after it is packed.
+            conn.packed_replies = !codec.empty();
+            std::cout << "Incoming client identification." << std::endl;
+            std::cout << "Identity: " << json::write(identity) << std::endl;
+            if (identity.user)
+            {
+                std::cout << "User client identified." << std::endl;
+                conn.user = true;
+                if (conn.has_device)
+                {
+                    delivery_queue &stored = offline_store_for(conn.sender);
+                    if (!stored.empty())
+                        std::cout << "Delivering " << stored.size() << " stored payloads." << std::endl;
+                    while (!stored.empty())
+                    {
+                        delivery_queue::entry item = stored.pop();
+                        conn.forward.push(item.collapse_key, std::move(item.text));
+                    }
+                }
+                std::cout << "Added user client to user client registry." << std::endl;
+            }
+            else
+            {
+                std::cout << "Home client identified." << std::endl;
+            }
+        }
+    }
+
+    void server::fan_out(std::string_view collapse_key, std::string_view text)
+    {
+        std::vector<uint64_t> online;
+        for (const std::unique_ptr<connection> &conn : m_connections)
+        {
+            if (conn && conn->user)
+            {
+                conn->forward.push(collapse_key, std::string(text));
+                online.push_back(conn->sender);
+            }
+        }
+        for (auto &stored : m_offline)
+        {
+            if (std::find(online.begin(), online.end(), stored.first) == online.end())
+                stored.second.pending.push(collapse_key, std::string(text));
+        }
+    }
+
+    delivery_queue &server::offline_store_for(uint64_t sender)
+    {
+        auto found = m_offline.find(sender);
+        if (found == m_offline.end())
+        {
+            if (m_offline.size() >= MAX_OFFLINE_USERS)
+            {
+                auto oldest = std::min_element(m_offline.begin(), m_offline.end(), [](const auto &a, const auto &b)
+                {
+                    return a.second.last_seen < b.second.last_seen;
+                });
+                std::cout << "Dropping " << oldest->second.pending.size()
+                          << " payloads stored for the user client seen longest ago." << std::endl;
+                m_offline.erase(oldest);
+            }
+            found = m_offline.emplace(sender, offline_store(m_offline_clock)).first;
+        }
+        found->second.last_seen = m_offline_clock++;
+        return found->second.pending;
+    }
+
+    void server::release_scheduled()
+    {
+        if (m_scheduler.empty())
+            return;
+        m_scheduler.advance(static_cast<int64_t>(trace::wall_ns() / 1000000), m_due);
+        if (m_due.empty())
+            return;
+        std::cout << "Releasing " << m_due.size() << " scheduled payloads." << std::endl;
+        for (const scheduler::item &it : m_due)
+            fan_out(it.collapse_key, it.text);
+        m_due.clear();
+    }
+
+    void server::flush(net::node::socket_fd sd, connection &conn)
+    {
+        while (!conn.forward.empty())
+        {
+            delivery_queue::entry item = conn.forward.pop();
+            std::string &out = conn.next_outbound();
+            if (conn.packed_replies)
+            {
+                std::string err;
+                json::msgpack::pack(json::JSON::parse(item.text, err), out);
+            }
+            else
+            {
+                out = std::move(item.text);
+            }
+        }
+        if (conn.outbound_count == 0)
+            return;
+        conn.outbound_iov.resize(conn.outbound_count);
+        for (size_t i = 0; i < conn.outbound_count; i++)
+        {
+            conn.outbound_iov[i].iov_base = const_cast<char *>(conn.outbound[i].data());
+            conn.outbound_iov[i].iov_len = conn.outbound[i].size();
         }
+        m_server->send(sd, conn.outbound_iov.data(), conn.outbound_count);
+        for (payload_trace &hops : conn.outbound_hops)
+            hops.stamp(trace::WRITE);
+        conn.outbound_count = 0;
+        conn.outbound_hops.clear();
     }
 
     server::~server()
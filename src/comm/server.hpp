@@ -1,11 +1,32 @@
 #ifndef COMM_SERVER_HPP
 #define COMM_SERVER_HPP
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include <comm/dedup.hpp>
+#include <comm/delivery_queue.hpp>
+#include <comm/scheduler.hpp>
 #include <net/tcp_server.hpp>
+#include <util/json_msgpack.hpp>
+#include <util/json_stream.hpp>
+#include <util/json_view.hpp>
+#include <util/push_payload.hpp>
 
 #define MAX_CLIENTS 30
+#define READ_SIZE 4096
+#define MAX_FRAME_SIZE (1024 * 1024)
+#define DEDUP_WINDOW_MS (2 * 60 * 1000)
+#define DEDUP_CAPACITY (64 * 1024)
+#define MAX_PENDING_PAYLOADS 1024
+#define MAX_PENDING_BYTES (1024 * 1024)
+// Stores kept for user clients that are offline; past this the one seen longest ago is dropped.
+#define MAX_OFFLINE_USERS 64
+// Payloads held for a later "deliver-at" are logged here, relative to the working directory, unless
+// NUBILUM_SCHEDULE_FILE names another file or is set empty to keep them in memory only.
+#define SCHEDULE_FILE "nubilum_schedule.log"
 
 namespace nubilum_ad_hominem
 {
@@ -20,10 +41,86 @@ namespace nubilum_ad_hominem
         int comm_thread();
 
     private:
+        // Payload bytes received so far on one client socket; the parser finds where each payload ends. A
+        // payload that starts with a MessagePack map or array marker is framed by its own length instead.
+        struct connection
+        {
+            connection() : parser(framing), packed(false), packed_replies(false), sender(0), has_device(false),
+                           user(false), forward(MAX_PENDING_PAYLOADS, MAX_PENDING_BYTES), outbound_count(0)
+            {}
+
+            std::string &next_outbound()
+            {
+                if (outbound_count == outbound.size())
+                    outbound.emplace_back();
+                std::string &out = outbound[outbound_count++];
+                out.clear();
+                return out;
+            }
+
+            json::sax_handler framing;
+            json::stream_parser parser;
+            json::msgpack::frame_scanner scan;
+            std::string frame;
+            bool packed;
+            bool packed_replies;
+
+            // Hash of the device id the client sent, so retransmits over a new connection still match. Until
+            // then, or if it sends none, a number no other connection has.
+            uint64_t sender;
+            bool has_device;
+            bool user;
+
+            // Payloads from home clients waiting to go out to this user client.
+            delivery_queue forward;
+
+            // Replies to the payloads of one read, written together by flush(). The buffers are kept
+            // between reads so replies are serialized into memory that is already there.
+            std::vector<std::string> outbound;
+            size_t outbound_count;
+            std::vector<payload_trace> outbound_hops;
+            std::vector<struct iovec> outbound_iov;
+        };
+
+        void add_client(net::node::socket_fd sd);
+
+        void remove_client(int i);
+
+        void dispatch(connection &conn, const json::view &payload, uint64_t recv_mono_ns, uint64_t recv_wall_ns);
+
+        // Hands a home client's payload to every user client, or to the offline store of a user who is
+        // not connected. The collapse key is already scoped to the sender.
+        void fan_out(std::string_view collapse_key, std::string_view text);
+
+        void release_scheduled();
+
+        void flush(net::node::socket_fd sd, connection &conn);
+
+        // Payloads for a user client are stored only if it named its device, since only then can it be
+        // recognized when it comes back.
+        struct offline_store
+        {
+            explicit offline_store(uint64_t seen) : pending(MAX_PENDING_PAYLOADS, MAX_PENDING_BYTES), last_seen(seen)
+            {}
+
+            delivery_queue pending;
+            uint64_t last_seen;
+        };
+
+        delivery_queue &offline_store_for(uint64_t sender);
+
         net::tcp_server *m_server;
         net::node::socket_fd m_client_socket;
         net::node::socket_fd m_clients[MAX_CLIENTS];
-        std::vector<net::node::socket_fd> m_user_clients;
+        std::unique_ptr<connection> m_connections[MAX_CLIENTS];
+        dedup_filter m_dedup;
+        uint64_t m_anonymous_sender;
+        scheduler m_scheduler;
+        std::vector<scheduler::item> m_due;
+
+        // Keyed by device id hash; a user has an entry from the first time it identifies.
+        std::unordered_map<uint64_t, offline_store> m_offline;
+        uint64_t m_offline_clock;
 
         fd_set m_readfds;
 
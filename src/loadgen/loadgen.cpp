@@ -0,0 +1,290 @@
+#include "loadgen.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <unistd.h>
+
+#include <util/JSON.hpp>
+#include <util/json_msgpack.hpp>
+#include <util/json_stream.hpp>
+#include <util/push_payload.hpp>
+#include <util/trace.hpp>
+
+static const int s_setup_timeout_ms = 2000;
+static const int s_drain_timeout_ms = 2000;
+static const size_t s_read_size = 4096;
+
+loadgen::loadgen(const options &opts) :
+        m_opts(opts), m_content(opts.content_size, 'x'), m_next_id(1),
+        m_sent(0), m_acked(0), m_missed(0), m_setup_failures(0)
+{
+}
+
+bool loadgen::setup(connection &conn, const bool user)
+{
+    uint64_t start_ns = trace::mono_ns();
+    conn.client.reset(new net::tcp_client([](const std::string &) {}, net::node::NO_FLAGS));
+    if (!conn.client->init_connect(m_opts.str_addr, m_opts.str_port))
+        return false;
+
+    // Every connection is its own device, so its ids are never taken for another connection's retransmits.
+    size_t index = static_cast<size_t>(&conn - m_connections.data());
+    json::JSON::object identity{
+            {"class",  user ? "mobile-device" : "home-device"},
+            {"device", "loadgen-" + std::to_string(getpid()) + "-" + std::to_string(index)},
+            {"user",   user}
+    };
+    if (m_opts.packed)
+        identity["codecs"] = json::JSON::array{CODEC_MSGPACK};
+    int id = m_next_id++;
+    conn.outstanding[id] = start_ns;
+    conn.client->send(json::JSON(json::JSON::object{
+            {"id",         id},
+            {"header",     "idt"},
+            {"importance", 5},
+            {"content",    identity},
+            {"timestamp",  static_cast<int64_t>(std::time(0))},
+            {"notify",     false}
+    }).dump());
+
+    struct pollfd pfd = {conn.client->get_socket(), POLLIN, 0};
+    while (!conn.outstanding.empty())
+    {
+        if (poll(&pfd, 1, s_setup_timeout_ms) <= 0 || !drain(conn, m_setup_latencies_ns))
+            return false;
+    }
+    return true;
+}
+
+void loadgen::send_push(connection &conn, const uint64_t intended_ns)
+{
+    int id = m_next_id++;
+    conn.outstanding[id] = intended_ns;
+    json::JSON payload = json::JSON::object{
+            {"id",         id},
+            {"header",     "msg"},
+            {"importance", 5},
+            {"content",    m_content},
+            {"timestamp",  static_cast<int64_t>(std::time(0))},
+            {"notify",     false}
+    };
+    conn.client->send(conn.packed ? json::msgpack::pack(payload) : payload.dump());
+    m_sent++;
+}
+
+size_t loadgen::drain(connection &conn, std::vector<uint64_t> &latencies_ns)
+{
+    char buf[s_read_size + 1];
+    int i_bytes_rcvd = conn.client->receive(buf, s_read_size);
+    if (i_bytes_rcvd <= 0)
+        return 0;
+    uint64_t now_ns = trace::mono_ns();
+    conn.buffer.append(buf, static_cast<size_t>(i_bytes_rcvd));
+
+    // Acks arrive back to back on the stream, as JSON text or MessagePack; keep whatever trails the last
+    // complete one for the next read.
+    json::sax_handler framing;
+    json::stream_parser parser(framing);
+    size_t pos = 0;
+    while ((pos = conn.buffer.find_first_not_of(" \t\r\n", pos)) != std::string::npos)
+    {
+        std::string_view rest = std::string_view(conn.buffer).substr(pos);
+        std::string err;
+        json::JSON value;
+        size_t used;
+        if (json::msgpack::is_frame_start(rest[0]))
+        {
+            used = json::msgpack::frame_size(rest, err);
+            if (used)
+                value = json::msgpack::unpack(rest.substr(0, used), err);
+        }
+        else
+        {
+            parser.reset();
+            used = parser.feed(rest);
+            if (parser.done())
+                value = json::JSON::parse(std::string(rest.substr(0, used)), err);
+            else
+                used = 0;
+        }
+        if (!used)
+            break;
+        pos += used;
+
+        if (value["header"].string_value() != "ack")
+            continue;
+        if (value["content"]["codec"].string_value() == CODEC_MSGPACK)
+            conn.packed = true;
+        auto iter = conn.outstanding.find(value["content"]["recv-id"].int_value());
+        if (iter == conn.outstanding.end())
+            continue;
+        latencies_ns.push_back(now_ns - iter->second);
+        conn.outstanding.erase(iter);
+    }
+    conn.buffer.erase(0, std::min(pos, conn.buffer.size()));
+
+    // A read that completed no ack is still progress; only a closed socket stops the connection.
+    return static_cast<size_t>(i_bytes_rcvd);
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, const double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[idx];
+}
+
+static void print_distribution(const char *name, std::vector<uint64_t> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    printf("%-10s n=%-9zu p50=%9.1fus  p99=%9.1fus  p999=%9.1fus  max=%9.1fus\n", name, samples.size(),
+           percentile(samples, 0.50) / 1e3, percentile(samples, 0.99) / 1e3,
+           percentile(samples, 0.999) / 1e3, samples.empty() ? 0.0 : samples.back() / 1e3);
+}
+
+void loadgen::report(const double elapsed_s) const
+{
+    uint64_t lost = 0;
+    for (const connection &conn : m_connections)
+        lost += conn.outstanding.size();
+
+    printf("connections: %zu up, %llu failed\n", m_connections.size(),
+           static_cast<unsigned long long>(m_setup_failures));
+    printf("pushes:      %llu sent, %llu acked, %llu unacked, %llu missed send slots\n",
+           static_cast<unsigned long long>(m_sent), static_cast<unsigned long long>(m_acked),
+           static_cast<unsigned long long>(lost), static_cast<unsigned long long>(m_missed));
+    printf("throughput:  %.1f acks/s over %.2fs\n", elapsed_s > 0 ? m_acked / elapsed_s : 0.0, elapsed_s);
+    print_distribution("ack", m_ack_latencies_ns);
+    print_distribution("setup", m_setup_latencies_ns);
+}
+
+int loadgen::run()
+{
+    if (m_opts.window == 0 && m_opts.rate <= 0)
+    {
+        std::cout << "[loadgen][error] open-loop mode needs a target rate" << std::endl;
+        return 1;
+    }
+
+    int total = m_opts.users + m_opts.homes;
+    m_connections.reserve(static_cast<size_t>(total));
+    for (int i = 0; i < total; i++)
+    {
+        connection conn;
+        if (setup(conn, i < m_opts.users))
+            m_connections.push_back(std::move(conn));
+        else
+            m_setup_failures++;
+    }
+    if (m_connections.empty())
+    {
+        std::cout << "[loadgen][error] no connection could be established" << std::endl;
+        report(0);
+        return 1;
+    }
+
+    std::vector<struct pollfd> pfds;
+    for (const connection &conn : m_connections)
+        pfds.push_back({conn.client->get_socket(), POLLIN, 0});
+
+    // In rate mode latency is measured from the intended send time, so a stalled server is not hidden by
+    // the generator waiting on it.
+    uint64_t start_ns = trace::mono_ns();
+    uint64_t end_ns = start_ns + static_cast<uint64_t>(m_opts.duration * 1e9);
+    uint64_t interval_ns = m_opts.rate > 0 ? static_cast<uint64_t>(1e9 / m_opts.rate) : 0;
+    uint64_t next_send_ns = start_ns;
+    size_t rr = 0;
+
+    auto has_capacity = [this](const connection &conn)
+    {
+        return conn.client && (m_opts.window == 0 || conn.outstanding.size() < static_cast<size_t>(m_opts.window));
+    };
+
+    uint64_t now_ns = start_ns;
+    while (now_ns < end_ns)
+    {
+        if (interval_ns > 0)
+        {
+            while (next_send_ns <= now_ns)
+            {
+                size_t tries = 0;
+                while (tries < m_connections.size() && !has_capacity(m_connections[rr]))
+                {
+                    rr = (rr + 1) % m_connections.size();
+                    tries++;
+                }
+                if (tries < m_connections.size())
+                {
+                    send_push(m_connections[rr], next_send_ns);
+                    rr = (rr + 1) % m_connections.size();
+                }
+                else
+                {
+                    m_missed++;
+                }
+                next_send_ns += interval_ns;
+            }
+        }
+        else
+        {
+            for (connection &conn : m_connections)
+            {
+                if (has_capacity(conn))
+                    send_push(conn, now_ns);
+            }
+        }
+
+        int timeout_ms = 10;
+        if (interval_ns > 0)
+            timeout_ms = static_cast<int>((next_send_ns - std::min(next_send_ns, trace::mono_ns())) / 1000000);
+        poll_once(pfds, timeout_ms);
+        now_ns = trace::mono_ns();
+    }
+    double elapsed_s = (trace::mono_ns() - start_ns) / 1e9;
+
+    uint64_t drain_end_ns = trace::mono_ns() + static_cast<uint64_t>(s_drain_timeout_ms) * 1000000;
+    while (trace::mono_ns() < drain_end_ns)
+    {
+        bool pending = false;
+        for (const connection &conn : m_connections)
+            pending = pending || (conn.client && !conn.outstanding.empty());
+        if (!pending)
+            break;
+        poll_once(pfds, 10);
+    }
+
+    report(elapsed_s);
+    return 0;
+}
+
+void loadgen::poll_once(std::vector<struct pollfd> &pfds, const int timeout_ms)
+{
+    if (poll(pfds.data(), pfds.size(), timeout_ms) <= 0)
+        return;
+
+    for (size_t i = 0; i < pfds.size(); i++)
+    {
+        if (pfds[i].fd < 0 || !(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+        size_t acked_before = m_ack_latencies_ns.size();
+        if (drain(m_connections[i], m_ack_latencies_ns) == 0)
+        {
+            m_connections[i].client->disconnect();
+            m_connections[i].client.reset();
+            pfds[i].fd = -1;
+        }
+        m_acked += m_ack_latencies_ns.size() - acked_before;
+    }
+}
+
+loadgen::~loadgen()
+{
+    for (connection &conn : m_connections)
+    {
+        if (conn.client)
+            conn.client->disconnect();
+    }
+}
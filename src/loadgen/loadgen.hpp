@@ -0,0 +1,68 @@
+#ifndef NUBILUM_AD_HOMINEM_LOADGEN_HPP
+#define NUBILUM_AD_HOMINEM_LOADGEN_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+
+#include <net/tcp_client.hpp>
+
+class loadgen
+{
+public:
+    struct options
+    {
+        std::string str_addr = "127.0.0.1";
+        std::string str_port = "669";
+        int users = 8;              // users + homes must fit the server's MAX_CLIENTS
+        int homes = 8;
+        double rate = 1000.0;       // pushes per second over all connections, 0 = as fast as acks allow
+        int window = 1;             // outstanding pushes per connection, 0 = open loop
+        double duration = 10.0;     // seconds
+        size_t content_size = 32;
+        bool packed = false;        // offer MessagePack in the idt and use it once the server agrees
+    };
+
+    explicit loadgen(const options &opts);
+
+    ~loadgen();
+
+    int run();
+
+private:
+    struct connection
+    {
+        std::unique_ptr<net::tcp_client> client;
+        std::string buffer;
+        std::unordered_map<int, uint64_t> outstanding;
+        bool packed = false;
+    };
+
+    bool setup(connection &conn, bool user);
+
+    void send_push(connection &conn, uint64_t intended_ns);
+
+    size_t drain(connection &conn, std::vector<uint64_t> &latencies_ns);
+
+    void poll_once(std::vector<struct pollfd> &pfds, int timeout_ms);
+
+    void report(double elapsed_s) const;
+
+    options m_opts;
+    std::vector<connection> m_connections;
+    std::string m_content;
+    int m_next_id;
+
+    uint64_t m_sent;
+    uint64_t m_acked;
+    uint64_t m_missed;
+    uint64_t m_setup_failures;
+    std::vector<uint64_t> m_ack_latencies_ns;
+    std::vector<uint64_t> m_setup_latencies_ns;
+};
+
+#endif //NUBILUM_AD_HOMINEM_LOADGEN_HPP
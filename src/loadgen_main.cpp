@@ -0,0 +1,53 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <loadgen/loadgen.hpp>
+
+static void usage(const char *argv0)
+{
+    std::cout << "usage: " << argv0 << " [--host addr] [--port port] [--users n] [--homes n] [--rate pushes/s]"
+              << " [--window n] [--duration s] [--size bytes] [--codec json|msgpack]" << std::endl
+              << "  --rate 0 sends as fast as the per-connection window allows; --window 0 is open loop." << std::endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    loadgen::options opts;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *arg = argv[i];
+        const char *val = argv[++i];
+        if (strcmp(arg, "--host") == 0)
+            opts.str_addr = val;
+        else if (strcmp(arg, "--port") == 0)
+            opts.str_port = val;
+        else if (strcmp(arg, "--users") == 0)
+            opts.users = atoi(val);
+        else if (strcmp(arg, "--homes") == 0)
+            opts.homes = atoi(val);
+        else if (strcmp(arg, "--rate") == 0)
+            opts.rate = atof(val);
+        else if (strcmp(arg, "--window") == 0)
+            opts.window = atoi(val);
+        else if (strcmp(arg, "--duration") == 0)
+            opts.duration = atof(val);
+        else if (strcmp(arg, "--size") == 0)
+            opts.content_size = static_cast<size_t>(atol(val));
+        else if (strcmp(arg, "--codec") == 0 && (strcmp(val, "json") == 0 || strcmp(val, "msgpack") == 0))
+            opts.packed = strcmp(val, "msgpack") == 0;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    loadgen generator(opts);
+    return generator.run();
+}
@@ -10,23 +10,25 @@
 
 mobile::mobile() : client()
 {
-    identity = json::JSON::object{
-            {"class", "mobile-device"},
-            {"user",  true}
-    };
+    identity.device_class = "mobile-device";
+    identity.user = true;
 }
 
 mobile::mobile(std::string str_addr, std::string str_port) : client(str_addr, str_port)
 {
-    identity = json::JSON::object{
-            {"class", "mobile-device"},
-            {"user",  true}
-    };
+    identity.device_class = "mobile-device";
+    identity.user = true;
 }
 
 int mobile::run()
 {
+    // Messages forwarded from other clients are the only payloads shown; acks are handled by send_async.
+    on("msg", [](const json::view &payload)
+    {
+        std::cout << "MSG: " << payload["content"].string_value() << std::endl;
+    });
     client::run();
+    set_batching(BATCH_MAX_BYTES, std::chrono::milliseconds(BATCH_MAX_DELAY_MS));
     while (true)
     {
         std::string str;
@@ -39,7 +41,11 @@ int mobile::run()
         else
         {
             push_payload payload("msg", 5, str, false);
-            m_client->send(payload.to_str());
+            send_async(payload, [id = payload.get_id()](bool acked)
+            {
+                if (!acked)
+                    std::cout << "No ack for payload " << id << "." << std::endl;
+            });
         }
     }
     return 0;
@@ -1,6 +1,10 @@
 #include "node.hpp"
 
 #include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 namespace net
 {
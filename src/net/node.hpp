@@ -2,7 +2,9 @@
 #define NET_NODE_HPP
 
 #include <string>
+#include <functional>
 #include <mutex>
+#include <stdexcept>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -0,0 +1,82 @@
+#include "resolver.hpp"
+
+#include <cstring>
+#include <netdb.h>
+
+namespace net
+{
+    std::mutex resolver::s_mtx;
+    std::unordered_map<std::string, resolver::entry> resolver::s_cache;
+
+    bool resolver::resolve(const std::string &host, const std::string &port, bool refresh,
+                           std::vector<endpoint> &out, bool &cached, std::string &err)
+    {
+        std::string key = host + '\n' + port;
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(s_mtx);
+            auto found = s_cache.find(key);
+            if (!refresh && found != s_cache.end() && now < found->second.expires)
+            {
+                out = found->second.endpoints;
+                cached = true;
+                return true;
+            }
+        }
+
+        // The lookup runs without the lock, so one slow name does not hold up the others.
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *p_result = nullptr;
+        int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &p_result);
+
+        std::vector<endpoint> by_family[2];
+        int first_family = AF_UNSPEC;
+        if (status == 0)
+        {
+            for (struct addrinfo *p_res = p_result; p_res != nullptr; p_res = p_res->ai_next)
+            {
+                if ((p_res->ai_family != AF_INET && p_res->ai_family != AF_INET6) ||
+                    p_res->ai_addrlen > sizeof(struct sockaddr_storage))
+                    continue;
+                if (first_family == AF_UNSPEC)
+                    first_family = p_res->ai_family;
+                endpoint ep;
+                memset(&ep.addr, 0, sizeof(ep.addr));
+                memcpy(&ep.addr, p_res->ai_addr, p_res->ai_addrlen);
+                ep.addr_len = p_res->ai_addrlen;
+                ep.family = p_res->ai_family;
+                by_family[ep.family == first_family ? 0 : 1].push_back(ep);
+            }
+        }
+        if (p_result != nullptr)
+            freeaddrinfo(p_result);
+
+        std::lock_guard<std::mutex> lock(s_mtx);
+        if (first_family == AF_UNSPEC)
+        {
+            err = status != 0 ? gai_strerror(status) : "no usable address";
+            auto found = s_cache.find(key);
+            if (found == s_cache.end())
+                return false;
+            out = found->second.endpoints;
+            cached = true;
+            return true;
+        }
+
+        out.clear();
+        for (size_t i = 0; i < by_family[0].size() || i < by_family[1].size(); i++)
+        {
+            for (const std::vector<endpoint> &family : by_family)
+            {
+                if (i < family.size())
+                    out.push_back(family[i]);
+            }
+        }
+        s_cache[key] = entry{out, now + std::chrono::milliseconds(RESOLVE_CACHE_TTL_MS)};
+        cached = false;
+        return true;
+    }
+}
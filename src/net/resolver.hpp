@@ -0,0 +1,47 @@
+#ifndef NET_RESOLVER_HPP
+#define NET_RESOLVER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+
+// getaddrinfo does not report record TTLs, so cached addresses live for a fixed time.
+#define RESOLVE_CACHE_TTL_MS (60 * 1000)
+
+namespace net
+{
+    struct endpoint
+    {
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        int family;
+    };
+
+    // Process-wide cache of resolved stream addresses, so a reconnect does not wait on DNS. A lookup that
+    // fails falls back to the expired entry, if there is one, so a DNS outage does not cut clients off
+    // from an address that worked before.
+    class resolver
+    {
+    public:
+        // IPv6 and IPv4 addresses alternate, starting with the family getaddrinfo listed first, which is
+        // the order Happy Eyeballs tries them in. cached tells whether the answer came from the cache;
+        // refresh skips the cache unless the lookup fails.
+        static bool resolve(const std::string &host, const std::string &port, bool refresh,
+                            std::vector<endpoint> &out, bool &cached, std::string &err);
+
+    private:
+        struct entry
+        {
+            std::vector<endpoint> endpoints;
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        static std::mutex s_mtx;
+        static std::unordered_map<std::string, entry> s_cache;
+    };
+}
+
+#endif //NET_RESOLVER_HPP
@@ -1,10 +1,17 @@
 #include "tcp_client.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <vector>
 
 #include <cstdarg>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include <net/utils.hpp>
@@ -12,7 +19,7 @@
 namespace net
 {
     tcp_client::tcp_client(const log_fn_callback logger, const settings_flag settings) :
-            node(logger, settings), m_status(DISCONNECTED), m_p_result_addrinfo(nullptr), m_socket(INVALID_SOCKET)
+            node(logger, settings), m_status(DISCONNECTED), m_socket(INVALID_SOCKET)
     {
     }
 
@@ -26,50 +33,127 @@ namespace net
                         "[tcp_client][warning] Opening a new connection; the last connection was automatically closed."));
         }
 
-        memset(&m_hints_addr_info, 0, sizeof(m_hints_addr_info));
-        m_hints_addr_info.ai_family = AF_INET;
-        m_hints_addr_info.ai_socktype = SOCK_STREAM;
+        std::vector<endpoint> endpoints;
+        bool cached;
+        std::string err;
+        if (!resolver::resolve(str_server, str_port, false, endpoints, cached, err))
+        {
+            if (m_settings_flags & ENABLE_LOG)
+                m_logger(str_format("[tcp_client][error] getaddrinfo failed: %s", err.c_str()));
+            return false;
+        }
 
-        if (getaddrinfo(str_server.c_str(), str_port.c_str(), &m_hints_addr_info,
-                        &m_p_result_addrinfo) != 0)
+        // Cached addresses that all fail may be out of date, so they are looked up once more.
+        m_socket = race_connect(endpoints, err);
+        if (m_socket == INVALID_SOCKET && cached && resolver::resolve(str_server, str_port, true, endpoints, cached, err)
+            && !cached)
+            m_socket = race_connect(endpoints, err);
+
+        if (m_socket == INVALID_SOCKET)
         {
             if (m_settings_flags & ENABLE_LOG)
-                m_logger(str_format("[tcp_client][error] getaddrinfo failed: %s", strerror(errno)));
-            if (m_p_result_addrinfo != nullptr)
-            {
-                freeaddrinfo(m_p_result_addrinfo);
-                m_p_result_addrinfo = nullptr;
-            }
+                m_logger(str_format("[tcp_client][error] connect failed: %s", err.c_str()));
             return false;
         }
+        m_status = CONNECTED;
+        return true;
+    }
 
-        struct addrinfo *p_res;
-        for (p_res = m_p_result_addrinfo; p_res != nullptr; p_res = p_res->ai_next)
+    node::socket_fd tcp_client::race_connect(const std::vector<endpoint> &endpoints, std::string &err) const
+    {
+        struct attempt
         {
-            m_socket = socket(p_res->ai_family, p_res->ai_socktype, p_res->ai_protocol);
-            if (m_socket < 0)
+            socket_fd fd;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        std::vector<attempt> running;
+        std::vector<struct pollfd> poll_fds;
+        socket_fd winner = INVALID_SOCKET;
+        size_t next = 0;
+        auto next_start = std::chrono::steady_clock::now();
+        while (winner == INVALID_SOCKET && (next < endpoints.size() || !running.empty()))
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (next < endpoints.size() && (running.empty() || now >= next_start))
+            {
+                const endpoint &ep = endpoints[next++];
+                socket_fd fd = socket(ep.family, SOCK_STREAM, 0);
+                if (fd < 0)
+                {
+                    err = strerror(errno);
+                    continue;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                if (connect(fd, reinterpret_cast<const struct sockaddr *>(&ep.addr), ep.addr_len) == 0)
+                {
+                    winner = fd;
+                    break;
+                }
+                if (errno != EINPROGRESS)
+                {
+                    err = strerror(errno);
+                    close(fd);
+                    continue;
+                }
+                running.push_back(attempt{fd, now + std::chrono::milliseconds(CONNECT_TIMEOUT_MS)});
+                next_start = now + std::chrono::milliseconds(CONNECT_ATTEMPT_DELAY_MS);
+            }
+            if (running.empty())
                 continue;
 
-            if (connect(m_socket, p_res->ai_addr, p_res->ai_addrlen) >= 0)
+            // Sleep until an attempt finishes, one times out, or the next one is due.
+            auto wake = running.front().deadline;
+            for (const attempt &a : running)
+                wake = std::min(wake, a.deadline);
+            if (next < endpoints.size())
+                wake = std::min(wake, next_start);
+            auto wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count() + 1;
+
+            poll_fds.clear();
+            for (const attempt &a : running)
+                poll_fds.push_back(pollfd{a.fd, POLLOUT, 0});
+            if (poll(poll_fds.data(), poll_fds.size(), static_cast<int>(std::max<int64_t>(wait_ms, 0))) < 0 &&
+                errno != EINTR)
+            {
+                err = strerror(errno);
+                break;
+            }
+
+            now = std::chrono::steady_clock::now();
+            for (size_t i = running.size(); i-- > 0;)
             {
-                m_status = CONNECTED;
-                if (m_p_result_addrinfo != nullptr)
+                if (poll_fds[i].revents != 0)
                 {
-                    freeaddrinfo(m_p_result_addrinfo);
-                    m_p_result_addrinfo = nullptr;
+                    int so_error = 0;
+                    socklen_t len = sizeof(so_error);
+                    getsockopt(running[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+                    if (so_error == 0 && winner == INVALID_SOCKET)
+                    {
+                        winner = running[i].fd;
+                        running.erase(running.begin() + i);
+                        continue;
+                    }
+                    err = strerror(so_error);
                 }
-                return true;
+                else if (now < running[i].deadline)
+                {
+                    continue;
+                }
+                else
+                {
+                    err = "connection timed out";
+                }
+                close(running[i].fd);
+                running.erase(running.begin() + i);
             }
-            close(m_socket);
         }
-        if (m_p_result_addrinfo != nullptr)
-        {
-            freeaddrinfo(m_p_result_addrinfo);
-            m_p_result_addrinfo = nullptr;
-        }
-        if (m_settings_flags & ENABLE_LOG)
-            m_logger(str_format("[tcp_client][error] no such host"));
-        return false;
+
+        for (const attempt &a : running)
+            close(a.fd);
+        if (winner != INVALID_SOCKET)
+            fcntl(winner, F_SETFL, fcntl(winner, F_GETFL, 0) & ~O_NONBLOCK);
+        return winner;
     }
 
     bool tcp_client::send(const char *data_ptr, const size_t size) const
@@ -1,9 +1,16 @@
 #ifndef NET_TCP_CLIENT_HPP
 #define NET_TCP_CLIENT_HPP
 
-#include <netdb.h>
+#include <string>
+#include <vector>
 
 #include <net/node.hpp>
+#include <net/resolver.hpp>
+
+// Happy Eyeballs pacing: the next address is tried after this long without a connection, or sooner if the
+// attempts under way have all failed.
+#define CONNECT_ATTEMPT_DELAY_MS 250
+#define CONNECT_TIMEOUT_MS 5000
 
 namespace net
 {
@@ -19,6 +26,8 @@ namespace net
 
         tcp_client &operator=(const tcp_client &) = delete;
 
+        // Connects to every address the server name has, IPv6 and IPv4 alike, with attempts staggered and
+        // run in parallel, and keeps whichever connects first. Addresses come from the resolver cache.
         bool init_connect(std::string str_server, std::string str_port);
 
         int receive(char *data_ptr, size_t size) const;
@@ -31,6 +40,11 @@ namespace net
 
         bool disconnect();
 
+        socket_fd get_socket() const
+        {
+            return m_socket;
+        }
+
     protected:
         enum connection_status
         {
@@ -38,10 +52,10 @@ namespace net
             DISCONNECTED
         };
 
+        socket_fd race_connect(const std::vector<endpoint> &endpoints, std::string &err) const;
+
         connection_status m_status;
         socket_fd m_socket;
-        struct addrinfo *m_p_result_addrinfo;
-        struct addrinfo m_hints_addr_info;
     };
 }
 
@@ -3,7 +3,11 @@
 #include <iostream>
 #include <vector>
 
+#include <algorithm>
+#include <climits>
 #include <cstdarg>
+#include <cerrno>
+#include <cstring>
 
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -87,6 +91,7 @@ namespace net
         {
             if (m_settings_flags & ENABLE_LOG)
                 m_logger(str_format("[tcp_server][error] reading from socket: %s", strerror(errno)));
+            return i_bytes_rcvd;
         }
         data_ptr[i_bytes_rcvd] = 0;
         return i_bytes_rcvd;
@@ -114,6 +119,36 @@ namespace net
         return send(client_socket, data.data(), data.size());
     }
 
+    bool tcp_server::send(const socket_fd client_socket, struct iovec *iov, size_t count) const
+    {
+        while (count > 0)
+        {
+            ssize_t i_res = writev(client_socket, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)));
+            if (i_res < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (m_settings_flags & ENABLE_LOG)
+                    m_logger(str_format("[tcp_server][error] writing to socket: %s", strerror(errno)));
+                return false;
+            }
+
+            size_t written = static_cast<size_t>(i_res);
+            while (count > 0 && written >= iov->iov_len)
+            {
+                written -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0)
+            {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+        return true;
+    }
+
     bool tcp_server::disconnect(const socket_fd client_socket) const
     {
         close(client_socket);
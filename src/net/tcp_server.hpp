@@ -1,6 +1,9 @@
 #ifndef NET_TCP_SERVER_HPP
 #define NET_TCP_SERVER_HPP
 
+#include <vector>
+#include <sys/uio.h>
+
 #include <net/node.hpp>
 
 namespace net
@@ -27,6 +30,10 @@ namespace net
 
         bool send(const node::socket_fd client_socket, const std::vector<char> &data) const;
 
+        // Gathers the buffers with writev instead of copying them together. iov is advanced past whatever
+        // has been written, so it is left modified.
+        bool send(const node::socket_fd client_socket, struct iovec *iov, size_t count) const;
+
         bool disconnect(const node::socket_fd client_socket) const;
 
         node::socket_fd m_listen_socket;
@@ -2,9 +2,14 @@
 #include <iostream>
 
 #include <comm/server.hpp>
+#include <util/payload_id.hpp>
+#include <util/trace.hpp>
 
 int main(int argc, char const *argv[])
 {
+    trace::configure_from_env();
+    if (!payload_id::configure_from_env())
+        return 1;
     nubilum_ad_hominem::server *server = new nubilum_ad_hominem::server("669");
     server->run();
 }
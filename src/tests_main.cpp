@@ -0,0 +1,422 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <comm/scheduler.hpp>
+#include <comm/server.hpp>
+#include <net/tcp_client.hpp>
+#include <util/JSON.hpp>
+#include <util/json_arena.hpp>
+#include <util/json_stream.hpp>
+#include <util/json_view.hpp>
+#include <util/payload_id.hpp>
+
+using nubilum_ad_hominem::scheduler;
+
+static const char *s_filter = nullptr;
+static int s_failed_checks = 0;
+static int s_failed_tests = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static bool check(const bool ok, const char *what, const char *file, const int line)
+{
+    if (!ok)
+    {
+        printf("  %s:%d: CHECK(%s) failed\n", file, line, what);
+        s_failed_checks++;
+    }
+    return ok;
+}
+
+template<typename F>
+static void test(const std::string &name, F &&fn)
+{
+    if (s_filter != nullptr && name.find(s_filter) == std::string::npos)
+        return;
+
+    int failed_before = s_failed_checks;
+    fn();
+    bool passed = s_failed_checks == failed_before;
+    if (!passed)
+        s_failed_tests++;
+    printf("%-60s %s\n", name.c_str(), passed ? "ok" : "FAILED");
+}
+
+static std::string scratch_path(const std::string &name)
+{
+    const char *dir = getenv("TMPDIR");
+    return std::string(dir != nullptr && *dir ? dir : "/tmp") + "/nubilum-tests-" + std::to_string(getpid()) + "-" +
+           name;
+}
+
+static bool file_exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static void json_tests()
+{
+    test("json/int64_value of numbers no int64 can hold", []()
+    {
+        const char *cases[][2] = {
+                {"1e300",                  "0"},
+                {"-1e300",                 "0"},
+                {"9223372036854775808.0",  "0"},
+                {"-9223372036854775808.0", "-9223372036854775808"},
+                {"12.75",                  "12"},
+                {"-12.75",                 "-12"}
+        };
+        for (const auto &c : cases)
+        {
+            std::string text = std::string("{\"id\": ") + c[0] + "}";
+            int64_t expected = std::stoll(c[1]);
+            std::string err;
+            CHECK(json::JSON::parse(text, err)["id"].int64_value() == expected);
+
+            json::document doc(text);
+            CHECK(doc.valid() && doc.root()["id"].int64_value() == expected);
+
+            json::arena scratch;
+            CHECK(json::arena_json::parse(scratch, text, err)["id"].int64_value() == expected);
+        }
+    });
+
+    test("json/int_value of numbers no int can hold", []()
+    {
+        std::string err;
+        CHECK(json::JSON::parse("1e300", err).int_value() == 0);
+        CHECK(json::JSON::parse("3e9", err).int_value() == 0);
+        CHECK(json::JSON::parse("-2147483648.5", err).int_value() == -2147483647 - 1);
+        CHECK(json::JSON(std::numeric_limits<double>::quiet_NaN()).int64_value() == 0);
+
+        json::arena scratch;
+        CHECK(json::arena_json::parse(scratch, "-1e300", err).int_value() == 0);
+    });
+}
+
+static void payload_id_tests()
+{
+    test("payload_id/NUBILUM_NODE_ID is checked", []()
+    {
+        uint32_t before = payload_id::node();
+        for (const char *valid : {"0", "7", "255"})
+        {
+            setenv("NUBILUM_NODE_ID", valid, 1);
+            CHECK(payload_id::configure_from_env());
+            CHECK(payload_id::node() == std::stoul(valid));
+        }
+
+        payload_id::set_node(7);
+        for (const char *invalid : {"256", "-1", "abc", "12abc", " 5", "99999999999999999999999"})
+        {
+            setenv("NUBILUM_NODE_ID", invalid, 1);
+            CHECK(!payload_id::configure_from_env());
+            CHECK(payload_id::node() == 7);
+        }
+
+        // Unset keeps the process id default, with a warning.
+        unsetenv("NUBILUM_NODE_ID");
+        CHECK(payload_id::configure_from_env());
+        CHECK(payload_id::node() == 7);
+        payload_id::set_node(before);
+    });
+}
+
+static void scheduler_tests()
+{
+    test("scheduler/log is created by the first add", []()
+    {
+        std::string path = scratch_path("lazy.log");
+        {
+            scheduler s(1000);
+            CHECK(s.open(path));
+            std::vector<scheduler::item> due;
+            s.advance(100000, due);
+            CHECK(!file_exists(path));
+            s.add(200000, "", "a");
+            CHECK(file_exists(path));
+        }
+        scheduler s(1000);
+        CHECK(s.open(path));
+        CHECK(s.size() == 1);
+        remove(path.c_str());
+    });
+
+    test("scheduler/adds after a compaction survive a restart", []()
+    {
+        std::string path = scratch_path("compact.log");
+        {
+            scheduler s(1000);
+            CHECK(s.open(path));
+            for (int i = 0; i < 6000; i++)
+                s.add(2000 + i, "", "released");
+            std::vector<scheduler::item> due;
+            s.advance(9000, due);
+            CHECK(due.size() == 6000);
+            CHECK(s.empty());
+
+            // The log was rewritten while releasing; later records go to the rewritten file.
+            s.add(900000, "", "after");
+            due.clear();
+            s.advance(9100, due);
+        }
+        scheduler s(9100);
+        CHECK(s.open(path));
+        CHECK(s.size() == 1);
+        std::vector<scheduler::item> due;
+        s.advance(1000000, due);
+        CHECK(due.size() == 1 && due[0].text == "after");
+        remove(path.c_str());
+    });
+
+    test("scheduler/failed compaction keeps logging to the old log", []()
+    {
+        std::string path = scratch_path("blocked.log");
+        std::string tmp_path = path + ".tmp";
+        {
+            scheduler s(1000);
+            CHECK(s.open(path));
+            s.add(900000, "", "kept");
+
+            // A directory where the rewritten log would go makes every compaction fail.
+            CHECK(mkdir(tmp_path.c_str(), 0700) == 0);
+            for (int i = 0; i < 6000; i++)
+                s.add(2000 + i, "", "released");
+            std::vector<scheduler::item> due;
+            s.advance(9000, due);
+            CHECK(due.size() == 6000);
+            s.add(900000, "", "later");
+        }
+        rmdir(tmp_path.c_str());
+
+        // The released batch was recorded as done and both live items were logged.
+        scheduler s(9000);
+        CHECK(s.open(path));
+        CHECK(s.size() == 2);
+        remove(path.c_str());
+    });
+}
+
+// One server for the whole run, on its own port, fed by peers that speak the text protocol.
+static const char *s_server_port = "16690";
+static int s_next_payload_id = 1;
+
+struct peer
+{
+    std::unique_ptr<net::tcp_client> client;
+    std::string buffer;
+    std::vector<json::JSON> received;
+};
+
+static bool connect_peer(peer &p)
+{
+    static bool started = false;
+    if (!started)
+    {
+        // The server's constructor only returns once its first client has connected.
+        started = true;
+        setenv("NUBILUM_SCHEDULE_FILE", "", 1);
+        std::thread([]()
+        {
+            nubilum_ad_hominem::server *server = new nubilum_ad_hominem::server(s_server_port);
+            server->run();
+        }).detach();
+    }
+
+    for (int attempt = 0; attempt < 200; attempt++)
+    {
+        p.client.reset(new net::tcp_client([](const std::string &) {}, net::node::NO_FLAGS));
+        if (p.client->init_connect("127.0.0.1", s_server_port))
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static void send_payload(peer &p, const std::string &header, const json::JSON &content,
+                         const json::JSON::object &extra = {})
+{
+    json::JSON::object payload{
+            {"id",         s_next_payload_id++},
+            {"header",     header},
+            {"importance", 5},
+            {"content",    content},
+            {"timestamp",  0},
+            {"notify",     false}
+    };
+    for (const auto &field : extra)
+        payload[field.first] = field.second;
+    p.client->send(json::JSON(payload).dump());
+}
+
+// Waits until count payloads with this header have arrived, or timeout_ms passes, and takes them.
+static std::vector<json::JSON> receive_payloads(peer &p, const std::string &header, const size_t count,
+                                                const int timeout_ms = 1000)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::vector<json::JSON> taken;
+    while (true)
+    {
+        for (auto it = p.received.begin(); it != p.received.end() && taken.size() < count;)
+        {
+            if ((*it)["header"].string_value() == header)
+            {
+                taken.push_back(*it);
+                it = p.received.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        int left_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count());
+        if (taken.size() >= count || left_ms <= 0)
+            return taken;
+
+        struct pollfd pfd = {p.client->get_socket(), POLLIN, 0};
+        if (poll(&pfd, 1, left_ms) <= 0)
+            continue;
+        char buf[4096];
+        int i_bytes_rcvd = p.client->receive(buf, sizeof(buf));
+        if (i_bytes_rcvd <= 0)
+            return taken;
+        p.buffer.append(buf, static_cast<size_t>(i_bytes_rcvd));
+
+        json::sax_handler framing;
+        json::stream_parser parser(framing);
+        size_t pos = 0;
+        while ((pos = p.buffer.find_first_not_of(" \t\r\n", pos)) != std::string::npos)
+        {
+            parser.reset();
+            size_t used = parser.feed(std::string_view(p.buffer).substr(pos));
+            if (!parser.done())
+                break;
+            std::string err;
+            p.received.push_back(json::JSON::parse(p.buffer.substr(pos, used), err));
+            pos += used;
+        }
+        p.buffer.erase(0, std::min(pos, p.buffer.size()));
+    }
+}
+
+static bool identify(peer &p, const std::string &device, const bool user)
+{
+    send_payload(p, "idt", json::JSON::object{
+            {"class",  user ? "mobile-device" : "home-device"},
+            {"device", device},
+            {"user",   user}
+    });
+    return receive_payloads(p, "ack", 1).size() == 1;
+}
+
+static void server_tests()
+{
+    test("server/acks ids and due times no int64 can hold", []()
+    {
+        peer home;
+        CHECK(connect_peer(home) && identify(home, "huge-home-" + std::to_string(getpid()), false));
+        home.client->send("{\"id\": 1e300, \"header\": \"msg\", \"importance\": 5, \"content\": \"x\", "
+                          "\"timestamp\": 0, \"notify\": false, \"deliver-at\": -1e300}");
+        CHECK(receive_payloads(home, "ack", 1).size() == 1);
+    });
+
+    test("server/payloads without an id are not taken for retransmits", []()
+    {
+        std::string tag = std::to_string(getpid());
+        peer phone, home;
+        CHECK(connect_peer(phone) && identify(phone, "idless-phone-" + tag, true));
+        CHECK(connect_peer(home) && identify(home, "idless-home-" + tag, false));
+
+        for (const char *content : {"first", "second"})
+        {
+            home.client->send(std::string("{\"header\": \"msg\", \"importance\": 5, \"content\": \"") + content +
+                              "\", \"timestamp\": 0, \"notify\": false}");
+            CHECK(receive_payloads(home, "ack", 1).size() == 1);
+        }
+
+        // A payload sent twice under one id still goes out once.
+        json::JSON::object retransmit{
+                {"id",         s_next_payload_id++},
+                {"header",     "msg"},
+                {"importance", 5},
+                {"content",    "third"},
+                {"timestamp",  0},
+                {"notify",     false}
+        };
+        for (int i = 0; i < 2; i++)
+        {
+            home.client->send(json::JSON(retransmit).dump());
+            CHECK(receive_payloads(home, "ack", 1).size() == 1);
+        }
+
+        std::vector<json::JSON> received = receive_payloads(phone, "msg", 4, 300);
+        CHECK(received.size() == 3);
+        if (received.size() == 3)
+        {
+            CHECK(received[0]["content"].string_value() == "first");
+            CHECK(received[1]["content"].string_value() == "second");
+            CHECK(received[2]["content"].string_value() == "third");
+        }
+    });
+
+    test("server/collapse keys are scoped to their sender", []()
+    {
+        std::string tag = std::to_string(getpid());
+        peer phone, home_a, home_b;
+        CHECK(connect_peer(phone) && identify(phone, "collapse-phone-" + tag, true));
+        CHECK(connect_peer(home_a) && identify(home_a, "collapse-home-a-" + tag, false));
+        CHECK(connect_peer(home_b) && identify(home_b, "collapse-home-b-" + tag, false));
+
+        // With the phone offline the updates wait in its store, where collapsing happens.
+        phone.client->disconnect();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        // Home A's second update, the same key spelled without an escape, replaces its first; home B's
+        // update under the same key is kept beside it.
+        home_a.client->send("{\"id\": " + std::to_string(s_next_payload_id++) + ", \"header\": \"msg\", "
+                            "\"importance\": 5, \"content\": \"a1\", \"timestamp\": 0, \"notify\": false, "
+                            "\"collapse\": \"thermo\\u0073tat\"}");
+        CHECK(receive_payloads(home_a, "ack", 1).size() == 1);
+        send_payload(home_a, "msg", "a2", {{"collapse", "thermostat"}});
+        CHECK(receive_payloads(home_a, "ack", 1).size() == 1);
+        send_payload(home_b, "msg", "b1", {{"collapse", "thermostat"}});
+        CHECK(receive_payloads(home_b, "ack", 1).size() == 1);
+
+        peer back;
+        CHECK(connect_peer(back) && identify(back, "collapse-phone-" + tag, true));
+        std::vector<json::JSON> stored = receive_payloads(back, "msg", 3, 300);
+        CHECK(stored.size() == 2);
+        if (stored.size() == 2)
+        {
+            CHECK(stored[0]["content"].string_value() == "a2");
+            CHECK(stored[1]["content"].string_value() == "b1");
+        }
+    });
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc > 1)
+        s_filter = argv[1];
+
+    json_tests();
+    payload_id_tests();
+    scheduler_tests();
+    server_tests();
+
+    if (s_failed_tests > 0)
+        printf("%d tests failed\n", s_failed_tests);
+    return s_failed_tests > 0 ? 1 : 0;
+}
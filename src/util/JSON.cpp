@@ -1,10 +1,18 @@
 #include "JSON.hpp"
+#include "json_detail.hpp"
+#include "json_simd.hpp"
 
 #include <cassert>
+#include <charconv>
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <limits>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <new>
 
 namespace json
 {
@@ -12,60 +20,104 @@ namespace json
 
     using std::string;
     using std::vector;
-    using std::map;
     using std::make_shared;
     using std::initializer_list;
     using std::move;
 
-    struct null_struct
+    void detail::dump_number(double value, string &out)
     {
-        bool operator==(null_struct) const
+        if (std::isfinite(value))
         {
-            return true;
+            // Shortest text that reads back as the same double.
+            char buf[32];
+            std::to_chars_result res = std::to_chars(buf, buf + sizeof buf, value);
+            out.append(buf, res.ptr);
         }
-
-        bool operator<(null_struct) const
+        else
         {
-            return false;
+            out += "null";
         }
-    };
+    }
 
-    static void dump(null_struct, string &out)
+    void detail::dump_number(int value, string &out)
     {
-        out += "null";
+        dump_number(static_cast<int64_t>(value), out);
     }
 
-    static void dump(double value, string &out)
+    void detail::dump_number(int64_t value, string &out)
     {
-        if (std::isfinite(value))
+        char buf[24];
+        char *p = buf + sizeof buf;
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        do
         {
-            char buf[32];
-            snprintf(buf, sizeof buf, "%.17g", value);
-            out += buf;
+            *--p = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0)
+            *--p = '-';
+        out.append(p, buf + sizeof buf);
+    }
+
+    detail::number detail::parse_number(const char *begin, const char *end)
+    {
+        const char *p = begin;
+        bool negative = p < end && *p == '-';
+        if (negative)
+            p++;
+
+        uint64_t magnitude = 0;
+        bool integer = true;
+        for (; p < end; p++)
+        {
+            if (*p < '0' || *p > '9' || __builtin_mul_overflow(magnitude, uint64_t(10), &magnitude)
+                || __builtin_add_overflow(magnitude, uint64_t(*p - '0'), &magnitude))
+            {
+                integer = false;
+                break;
+            }
         }
-        else
+
+        uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + (negative ? 1 : 0);
+        if (integer && magnitude <= limit)
+            return number{true, negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude), 0};
+
+        double value = 0;
+        if (std::from_chars(begin, end, value).ec == std::errc::result_out_of_range)
         {
-            out += "null";
+            // from_chars leaves the value alone here; strtod gives the usual infinity or zero.
+            value = strtod(string(begin, end).c_str(), nullptr);
         }
+        return number{false, 0, value};
     }
 
-    static void dump(int value, string &out)
+    int64_t detail::truncate_int64(double value)
     {
-        char buf[32];
-        snprintf(buf, sizeof buf, "%d", value);
-        out += buf;
+        // Both bounds are powers of two, so exact as doubles; NaN fails both comparisons.
+        if (value >= -9223372036854775808.0 && value < 9223372036854775808.0)
+            return static_cast<int64_t>(value);
+        return 0;
     }
 
-    static void dump(bool value, string &out)
+    int detail::truncate_int(double value)
     {
-        out += value ? "true" : "false";
+        if (value > std::numeric_limits<int>::min() - 1.0 && value < std::numeric_limits<int>::max() + 1.0)
+            return static_cast<int>(value);
+        return 0;
     }
 
-    static void dump(const string &value, string &out)
+    void detail::dump_string(std::string_view value, string &out)
     {
+        out.reserve(out.size() + value.length() + 2);
         out += '"';
         for (size_t i = 0; i < value.length(); i++)
         {
+            size_t run = simd::find_escape(value.data() + i, value.length() - i);
+            out.append(value, i, run);
+            i += run;
+            if (i == value.length())
+                break;
+
             const char ch = value[i];
             if (ch == '\\')
             {
@@ -101,14 +153,14 @@ namespace json
                 snprintf(buf, sizeof buf, "\\u%04x", ch);
                 out += buf;
             }
-            else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i + 1]) == 0x80
-                     && static_cast<uint8_t>(value[i + 2]) == 0xa8)
+            else if (static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.length()
+                     && static_cast<uint8_t>(value[i + 1]) == 0x80 && static_cast<uint8_t>(value[i + 2]) == 0xa8)
             {
                 out += "\\u2028";
                 i += 2;
             }
-            else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i + 1]) == 0x80
-                     && static_cast<uint8_t>(value[i + 2]) == 0xa9)
+            else if (static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.length()
+                     && static_cast<uint8_t>(value[i + 1]) == 0x80 && static_cast<uint8_t>(value[i + 2]) == 0xa9)
             {
                 out += "\\u2029";
                 i += 2;
@@ -121,6 +173,57 @@ namespace json
         out += '"';
     }
 
+    size_t detail::number_size(double value)
+    {
+        if (!std::isfinite(value))
+            return 4;
+        char buf[32];
+        return static_cast<size_t>(std::to_chars(buf, buf + sizeof buf, value).ptr - buf);
+    }
+
+    size_t detail::number_size(int64_t value)
+    {
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        size_t size = value < 0 ? 2 : 1;
+        for (; magnitude >= 10; magnitude /= 10)
+            size++;
+        return size;
+    }
+
+    size_t detail::string_size(std::string_view value)
+    {
+        size_t size = value.length() + 2;
+        for (size_t i = 0; i < value.length(); i++)
+        {
+            i += simd::find_escape(value.data() + i, value.length() - i);
+            if (i == value.length())
+                break;
+
+            const char ch = value[i];
+            if (ch == '\\' || ch == '"' || ch == '\b' || ch == '\f' || ch == '\n' || ch == '\r' || ch == '\t')
+            {
+                size += 1;
+            }
+            else if (static_cast<uint8_t>(ch) <= 0x1f)
+            {
+                size += 5;
+            }
+            else if (static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.length()
+                     && static_cast<uint8_t>(value[i + 1]) == 0x80
+                     && (static_cast<uint8_t>(value[i + 2]) == 0xa8 || static_cast<uint8_t>(value[i + 2]) == 0xa9))
+            {
+                size += 3;
+                i += 2;
+            }
+        }
+        return size;
+    }
+
+    static void dump(const string &value, string &out)
+    {
+        detail::dump_string(value, out);
+    }
+
     static void dump(const JSON::array &values, string &out)
     {
         bool first = true;
@@ -143,7 +246,7 @@ namespace json
         {
             if (!first)
                 out += ", ";
-            dump(kv.first, out);
+            dump(kv.first.str(), out);
             out += ": ";
             kv.second.dump(out);
             first = false;
@@ -151,9 +254,70 @@ namespace json
         out += "}";
     }
 
+    static size_t dump_size(const string &value)
+    {
+        return detail::string_size(value);
+    }
+
+    static size_t dump_size(const JSON::array &values)
+    {
+        size_t size = values.empty() ? 2 : values.size() * 2;
+        for (const auto &value : values)
+            size += value.dump_size();
+        return size;
+    }
+
+    static size_t dump_size(const JSON::object &values)
+    {
+        size_t size = values.empty() ? 2 : values.size() * 4;
+        for (const auto &kv : values)
+            size += detail::string_size(kv.first.str()) + kv.second.dump_size();
+        return size;
+    }
+
+    size_t JSON::dump_size() const
+    {
+        switch (m_storage)
+        {
+            case INLINE_NUL:
+                return 4;
+            case INLINE_BOOL:
+                return m_bool ? 4 : 5;
+            case INLINE_INT:
+                return detail::number_size(m_int);
+            case INLINE_DOUBLE:
+                return detail::number_size(m_double);
+            case INLINE_STRING:
+                return detail::string_size(m_str);
+            case HEAP:
+                return m_ptr->dump_size();
+        }
+        return 0;
+    }
+
     void JSON::dump(std::string &out) const
     {
-        m_ptr->dump(out);
+        switch (m_storage)
+        {
+            case INLINE_NUL:
+                out += "null";
+                break;
+            case INLINE_BOOL:
+                out += m_bool ? "true" : "false";
+                break;
+            case INLINE_INT:
+                detail::dump_number(m_int, out);
+                break;
+            case INLINE_DOUBLE:
+                detail::dump_number(m_double, out);
+                break;
+            case INLINE_STRING:
+                detail::dump_string(m_str, out);
+                break;
+            case HEAP:
+                m_ptr->dump(out);
+                break;
+        }
     }
 
     template<JSON::json_type tag, typename T>
@@ -181,79 +345,17 @@ namespace json
             return m_value < static_cast<const value<tag, T> *>(other)->m_value;
         }
 
-        const T m_value;
+        T m_value;
 
         void dump(string &out) const override
         {
             json::dump(m_value, out);
         }
-    };
-
-    class json_double final : public value<JSON::NUMBER, double>
-    {
-        double number_value() const override
-        {
-            return m_value;
-        }
-
-        int int_value() const override
-        {
-            return static_cast<int>(m_value);
-        }
-
-        bool equals(const json_value *other) const override
-        {
-            return m_value == other->number_value();
-        }
 
-        bool less(const json_value *other) const override
+        size_t dump_size() const override
         {
-            return m_value < other->number_value();
+            return json::dump_size(m_value);
         }
-
-    public:
-        explicit json_double(double val) : value(val)
-        {}
-    };
-
-    class json_int final : public value<JSON::NUMBER, int>
-    {
-        double number_value() const override
-        {
-            return m_value;
-        }
-
-        int int_value() const override
-        {
-            return m_value;
-        }
-
-        bool equals(const json_value *other) const override
-        {
-            return m_value == other->number_value();
-        }
-
-        bool less(const json_value *other) const override
-        {
-            return m_value < other->number_value();
-        }
-
-    public:
-        explicit json_int(int val) : value(val)
-        {}
-    };
-
-
-    class json_bool final : public value<JSON::BOOL, bool>
-    {
-        bool bool_value() const override
-        {
-            return m_value;
-        }
-
-    public:
-        explicit json_bool(bool val) : value(val)
-        {}
     };
 
     class json_string final : public value<JSON::STRING, string>
@@ -286,6 +388,11 @@ namespace json
 
         explicit json_array(JSON::array &&val) : value(move(val))
         {}
+
+        JSON::array &items()
+        {
+            return m_value;
+        }
     };
 
     class json_object final : public value<JSON::OBJECT, JSON::object>
@@ -295,7 +402,7 @@ namespace json
             return m_value;
         }
 
-        const JSON &operator[](const string &key) const override;
+        const JSON &operator[](const key &name) const override;
 
     public:
         explicit json_object(const JSON::object &val) : value(val)
@@ -303,24 +410,216 @@ namespace json
 
         explicit json_object(JSON::object &&val) : value(move(val))
         {}
+
+        JSON::object &items()
+        {
+            return m_value;
+        }
     };
 
 
-    class json_null final : public value<JSON::NUL, null_struct>
+    // Open addressing with insert-only slots, so lookups never lock. Names live for the whole program;
+    // once the table is half full, or for long names, interning stops and keys keep their own copy.
+    struct intern_table
     {
-    public:
-        json_null() : value({})
-        {}
+        static const size_t capacity = 4096;
+        static const size_t max_names = capacity / 2;
+        static const size_t max_length = 64;
+
+        std::atomic<const string *> slots[capacity];
+        std::atomic<size_t> count;
+
+        intern_table() : count(0)
+        {
+            for (auto &slot : slots)
+                slot.store(nullptr, std::memory_order_relaxed);
+        }
+
+        const string *intern(std::string_view name)
+        {
+            if (name.size() > max_length)
+                return nullptr;
+
+            size_t hash = std::hash<std::string_view>()(name);
+            for (size_t probe = 0; probe < capacity; probe++)
+            {
+                std::atomic<const string *> &slot = slots[(hash + probe) & (capacity - 1)];
+                const string *current = slot.load(std::memory_order_acquire);
+                if (current == nullptr)
+                {
+                    if (count.load(std::memory_order_relaxed) >= max_names)
+                        return nullptr;
+                    const string *fresh = new string(name);
+                    if (slot.compare_exchange_strong(current, fresh, std::memory_order_acq_rel))
+                    {
+                        count.fetch_add(1, std::memory_order_relaxed);
+                        return fresh;
+                    }
+                    delete fresh;
+                }
+                if (*current == name)
+                    return current;
+            }
+            return nullptr;
+        }
     };
 
+    static intern_table &get_intern_table()
+    {
+        static intern_table table;
+        return table;
+    }
+
+    // Interned before anything else can fill the table; default and moved-from keys point here.
+    static const string *empty_name()
+    {
+        static const string *name = get_intern_table().intern(std::string_view());
+        return name;
+    }
+
+    key::key() noexcept : m_str(empty_name()), m_owned(false)
+    {}
+
+    key::key(std::string_view name) : m_str(get_intern_table().intern(name)), m_owned(false)
+    {
+        if (m_str == nullptr)
+        {
+            m_str = new string(name);
+            m_owned = true;
+        }
+    }
+
+    key::key(const key &other) : m_str(other.m_owned ? new string(*other.m_str) : other.m_str),
+                                 m_owned(other.m_owned)
+    {}
+
+    key::key(key &&other) noexcept : m_str(other.m_str), m_owned(other.m_owned)
+    {
+        other.m_str = empty_name();
+        other.m_owned = false;
+    }
+
+    key &key::operator=(const key &other)
+    {
+        if (this != &other)
+            *this = key(other);
+        return *this;
+    }
+
+    key &key::operator=(key &&other) noexcept
+    {
+        std::swap(m_str, other.m_str);
+        std::swap(m_owned, other.m_owned);
+        return *this;
+    }
+
+    key::~key()
+    {
+        if (m_owned)
+            delete m_str;
+    }
+
+    static bool member_less(const JSON::object::value_type &lhs, const JSON::object::value_type &rhs)
+    {
+        return lhs.first < rhs.first;
+    }
+
+    object_map object_map::adopt(std::vector<value_type> &&members)
+    {
+        object_map result;
+        result.m_items = move(members);
+        result.normalize(true);
+        return result;
+    }
+
+    void object_map::normalize(bool keep_last)
+    {
+        // Already sorted is the common case: dump() writes members in order.
+        if (!std::is_sorted(m_items.begin(), m_items.end(), member_less))
+            std::stable_sort(m_items.begin(), m_items.end(), member_less);
+
+        auto out = m_items.begin();
+        for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
+        {
+            if (out != m_items.begin() && (out - 1)->first == iter->first)
+            {
+                if (keep_last)
+                    *(out - 1) = move(*iter);
+                continue;
+            }
+            if (out != iter)
+                *out = move(*iter);
+            ++out;
+        }
+        m_items.erase(out, m_items.end());
+    }
+
+    object_map::iterator object_map::lower_bound(const key &name)
+    {
+        return std::lower_bound(m_items.begin(), m_items.end(), name, [](const value_type &item, const key &k)
+        {
+            return item.first < k;
+        });
+    }
+
+    object_map::iterator object_map::find(const key &name)
+    {
+        if (m_items.size() <= linear_max)
+        {
+            for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
+            {
+                if (iter->first == name)
+                    return iter;
+            }
+            return m_items.end();
+        }
+
+        auto iter = lower_bound(name);
+        return (iter != m_items.end() && iter->first == name) ? iter : m_items.end();
+    }
+
+    object_map::const_iterator object_map::find(const key &name) const
+    {
+        return const_cast<object_map *>(this)->find(name);
+    }
+
+    JSON &object_map::operator[](const key &name)
+    {
+        return emplace(name, JSON()).first->second;
+    }
+
+    std::pair<object_map::iterator, bool> object_map::emplace(key name, JSON value)
+    {
+        auto iter = lower_bound(name);
+        if (iter != m_items.end() && iter->first == name)
+            return {iter, false};
+        return {m_items.emplace(iter, move(name), move(value)), true};
+    }
+
+    size_t object_map::erase(const key &name)
+    {
+        auto iter = find(name);
+        if (iter == m_items.end())
+            return 0;
+        m_items.erase(iter);
+        return 1;
+    }
+
+    bool object_map::operator==(const object_map &rhs) const
+    {
+        return m_items == rhs.m_items;
+    }
+
+    bool object_map::operator<(const object_map &rhs) const
+    {
+        return m_items < rhs.m_items;
+    }
+
     struct statics
     {
-        const std::shared_ptr<json_value> null = make_shared<json_null>();
-        const std::shared_ptr<json_value> t = make_shared<json_bool>(true);
-        const std::shared_ptr<json_value> f = make_shared<json_bool>(false);
         const string empty_string;
         const vector<JSON> empty_vector;
-        const map<string, JSON> empty_map;
+        const JSON::object empty_map;
 
         statics()
         {}
@@ -338,85 +637,238 @@ namespace json
         return null_json;
     }
 
-    JSON::JSON() noexcept : m_ptr(statics().null)
+    JSON::JSON() noexcept : m_storage(INLINE_NUL), m_int(0)
     {}
 
-    JSON::JSON(std::nullptr_t) noexcept : m_ptr(statics().null)
+    JSON::JSON(std::nullptr_t) noexcept : JSON()
     {}
 
-    JSON::JSON(double value) : m_ptr(make_shared<json_double>(value))
-    {}
+    JSON::JSON(const JSON &other) : m_storage(INLINE_NUL), m_int(0)
+    {
+        copy_from(other);
+    }
 
-    JSON::JSON(int value) : m_ptr(make_shared<json_int>(value))
-    {}
+    JSON::JSON(JSON &&other) noexcept : m_storage(INLINE_NUL), m_int(0)
+    {
+        move_from(other);
+    }
+
+    JSON &JSON::operator=(const JSON &other)
+    {
+        if (this != &other)
+        {
+            destroy();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    JSON &JSON::operator=(JSON &&other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    JSON::~JSON()
+    {
+        destroy();
+    }
 
-    JSON::JSON(bool value) : m_ptr(value ? statics().t : statics().f)
+    JSON::JSON(double value) : m_storage(INLINE_DOUBLE), m_double(value)
     {}
 
-    JSON::JSON(const string &value) : m_ptr(make_shared<json_string>(value))
+    JSON::JSON(int value) : m_storage(INLINE_INT), m_int(value)
     {}
 
-    JSON::JSON(string &&value) : m_ptr(make_shared<json_string>(move(value)))
+    JSON::JSON(int64_t value) : m_storage(INLINE_INT), m_int(value)
     {}
 
-    JSON::JSON(const char *value) : m_ptr(make_shared<json_string>(value))
+    JSON::JSON(bool value) : m_storage(INLINE_BOOL), m_bool(value)
     {}
 
-    JSON::JSON(const JSON::array &values) : m_ptr(make_shared<json_array>(values))
+    JSON::JSON(const string &value) : m_storage(INLINE_NUL), m_int(0)
+    {
+        init_string(string(value));
+    }
+
+    JSON::JSON(string &&value) : m_storage(INLINE_NUL), m_int(0)
+    {
+        init_string(move(value));
+    }
+
+    JSON::JSON(const char *value) : m_storage(INLINE_NUL), m_int(0)
+    {
+        init_string(string(value));
+    }
+
+    JSON::JSON(const JSON::array &values) : m_storage(HEAP), m_ptr(make_shared<json_array>(values))
     {}
 
-    JSON::JSON(JSON::array &&values) : m_ptr(make_shared<json_array>(move(values)))
+    JSON::JSON(JSON::array &&values) : m_storage(HEAP), m_ptr(make_shared<json_array>(move(values)))
     {}
 
-    JSON::JSON(const JSON::object &values) : m_ptr(make_shared<json_object>(values))
+    JSON::JSON(const JSON::object &values) : m_storage(HEAP), m_ptr(make_shared<json_object>(values))
     {}
 
-    JSON::JSON(JSON::object &&values) : m_ptr(make_shared<json_object>(move(values)))
+    JSON::JSON(JSON::object &&values) : m_storage(HEAP), m_ptr(make_shared<json_object>(move(values)))
     {}
 
+    void JSON::init_string(string &&value)
+    {
+        if (value.size() <= inline_string_max)
+        {
+            new(&m_str) string(move(value));
+            m_storage = INLINE_STRING;
+        }
+        else
+        {
+            new(&m_ptr) std::shared_ptr<json_value>(make_shared<json_string>(move(value)));
+            m_storage = HEAP;
+        }
+    }
+
+    // Both helpers expect *this to hold nothing that needs destroying.
+    void JSON::copy_from(const JSON &other)
+    {
+        switch (other.m_storage)
+        {
+            case INLINE_STRING:
+                new(&m_str) string(other.m_str);
+                break;
+            case HEAP:
+                new(&m_ptr) std::shared_ptr<json_value>(other.m_ptr);
+                break;
+            default:
+                memcpy(static_cast<void *>(&m_int), &other.m_int, sizeof(m_int));
+                break;
+        }
+        m_storage = other.m_storage;
+    }
+
+    void JSON::move_from(JSON &other) noexcept
+    {
+        switch (other.m_storage)
+        {
+            case INLINE_STRING:
+                new(&m_str) string(move(other.m_str));
+                break;
+            case HEAP:
+                new(&m_ptr) std::shared_ptr<json_value>(move(other.m_ptr));
+                break;
+            default:
+                memcpy(static_cast<void *>(&m_int), &other.m_int, sizeof(m_int));
+                break;
+        }
+        m_storage = other.m_storage;
+    }
+
+    void JSON::destroy() noexcept
+    {
+        if (m_storage == INLINE_STRING)
+            m_str.~string();
+        else if (m_storage == HEAP)
+            m_ptr.~shared_ptr();
+        m_storage = INLINE_NUL;
+        m_int = 0;
+    }
+
     JSON::json_type JSON::type() const
     {
-        return m_ptr->type();
+        switch (m_storage)
+        {
+            case INLINE_BOOL:
+                return BOOL;
+            case INLINE_INT:
+            case INLINE_DOUBLE:
+                return NUMBER;
+            case INLINE_STRING:
+                return STRING;
+            case HEAP:
+                return m_ptr->type();
+            default:
+                return NUL;
+        }
     }
 
     double JSON::number_value() const
     {
-        return m_ptr->number_value();
+        if (m_storage == INLINE_INT)
+            return static_cast<double>(m_int);
+        return m_storage == INLINE_DOUBLE ? m_double : 0;
     }
 
     int JSON::int_value() const
     {
-        return m_ptr->int_value();
+        if (m_storage == INLINE_DOUBLE)
+            return detail::truncate_int(m_double);
+        return m_storage == INLINE_INT ? static_cast<int>(m_int) : 0;
+    }
+
+    int64_t JSON::int64_value() const
+    {
+        if (m_storage == INLINE_DOUBLE)
+            return detail::truncate_int64(m_double);
+        return m_storage == INLINE_INT ? m_int : 0;
     }
 
     bool JSON::bool_value() const
     {
-        return m_ptr->bool_value();
+        return m_storage == INLINE_BOOL && m_bool;
     }
 
     const string &JSON::string_value() const
     {
-        return m_ptr->string_value();
+        if (m_storage == INLINE_STRING)
+            return m_str;
+        return m_storage == HEAP ? m_ptr->string_value() : get_statics().empty_string;
     }
 
     const vector<JSON> &JSON::array_items() const
     {
-        return m_ptr->array_items();
+        return m_storage == HEAP ? m_ptr->array_items() : get_statics().empty_vector;
+    }
+
+    const JSON::object &JSON::object_items() const
+    {
+        return m_storage == HEAP ? m_ptr->object_items() : get_statics().empty_map;
+    }
+
+    JSON::array &JSON::mutable_array()
+    {
+        if (type() != ARRAY)
+            *this = array();
+        else if (m_ptr.use_count() > 1)
+            m_ptr = make_shared<json_array>(m_ptr->array_items());
+        return static_cast<json_array *>(m_ptr.get())->items();
+    }
+
+    JSON::object &JSON::mutable_object()
+    {
+        if (type() != OBJECT)
+            *this = object();
+        else if (m_ptr.use_count() > 1)
+            m_ptr = make_shared<json_object>(m_ptr->object_items());
+        return static_cast<json_object *>(m_ptr.get())->items();
     }
 
-    const map<string, JSON> &JSON::object_items() const
+    JSON &JSON::set(const key &name, JSON value)
     {
-        return m_ptr->object_items();
+        mutable_object()[name] = move(value);
+        return *this;
     }
 
     const JSON &JSON::operator[](size_t i) const
     {
-        return (*m_ptr)[i];
+        return m_storage == HEAP ? (*m_ptr)[i] : static_null();
     }
 
-    const JSON &JSON::operator[](const string &key) const
+    const JSON &JSON::operator[](const key &name) const
     {
-        return (*m_ptr)[key];
+        return m_storage == HEAP ? (*m_ptr)[name] : static_null();
     }
 
     double json_value::number_value() const
@@ -444,7 +896,7 @@ namespace json
         return get_statics().empty_vector;
     }
 
-    const map<string, JSON> &json_value::object_items() const
+    const JSON::object &json_value::object_items() const
     {
         return get_statics().empty_map;
     }
@@ -454,14 +906,14 @@ namespace json
         return static_null();
     }
 
-    const JSON &json_value::operator[](const string &) const
+    const JSON &json_value::operator[](const key &) const
     {
         return static_null();
     }
 
-    const JSON &json_object::operator[](const string &key) const
+    const JSON &json_object::operator[](const key &name) const
     {
-        auto iter = m_value.find(key);
+        auto iter = m_value.find(name);
         return (iter == m_value.end()) ? static_null() : iter->second;
     }
 
@@ -473,26 +925,52 @@ namespace json
 
     bool JSON::operator==(const JSON &other) const
     {
-        if (m_ptr == other.m_ptr)
-            return true;
-        if (m_ptr->type() != other.m_ptr->type())
+        json_type t = type();
+        if (t != other.type())
             return false;
 
-        return m_ptr->equals(other.m_ptr.get());
+        switch (t)
+        {
+            case NUL:
+                return true;
+            case BOOL:
+                return m_bool == other.m_bool;
+            case NUMBER:
+                if (m_storage == INLINE_INT && other.m_storage == INLINE_INT)
+                    return m_int == other.m_int;
+                return number_value() == other.number_value();
+            case STRING:
+                return string_value() == other.string_value();
+            default:
+                return m_ptr == other.m_ptr || m_ptr->equals(other.m_ptr.get());
+        }
     }
 
     bool JSON::operator<(const JSON &other) const
     {
-        if (m_ptr == other.m_ptr)
-            return false;
-        if (m_ptr->type() != other.m_ptr->type())
-            return m_ptr->type() < other.m_ptr->type();
+        json_type t = type();
+        if (t != other.type())
+            return t < other.type();
 
-        return m_ptr->less(other.m_ptr.get());
+        switch (t)
+        {
+            case NUL:
+                return false;
+            case BOOL:
+                return m_bool < other.m_bool;
+            case NUMBER:
+                if (m_storage == INLINE_INT && other.m_storage == INLINE_INT)
+                    return m_int < other.m_int;
+                return number_value() < other.number_value();
+            case STRING:
+                return string_value() < other.string_value();
+            default:
+                return m_ptr != other.m_ptr && m_ptr->less(other.m_ptr.get());
+        }
     }
 
 
-    static inline string esc(char c)
+    string detail::esc(char c)
     {
         char buf[12];
         if (static_cast<uint8_t>(c) >= 0x20 && static_cast<uint8_t>(c) <= 0x7f)
@@ -506,6 +984,37 @@ namespace json
         return string(buf);
     }
 
+    void detail::encode_utf8(long pt, string &out)
+    {
+        if (pt < 0)
+            return;
+
+        if (pt < 0x80)
+        {
+            out += static_cast<char>(pt);
+        }
+        else if (pt < 0x800)
+        {
+            out += static_cast<char>((pt >> 6) | 0xC0);
+            out += static_cast<char>((pt & 0x3F) | 0x80);
+        }
+        else if (pt < 0x10000)
+        {
+            out += static_cast<char>((pt >> 12) | 0xE0);
+            out += static_cast<char>(((pt >> 6) & 0x3F) | 0x80);
+            out += static_cast<char>((pt & 0x3F) | 0x80);
+        }
+        else
+        {
+            out += static_cast<char>((pt >> 18) | 0xF0);
+            out += static_cast<char>(((pt >> 12) & 0x3F) | 0x80);
+            out += static_cast<char>(((pt >> 6) & 0x3F) | 0x80);
+            out += static_cast<char>((pt & 0x3F) | 0x80);
+        }
+    }
+
+    using detail::esc;
+
     static inline bool in_range(long x, long lower, long upper)
     {
         return (x >= lower && x <= upper);
@@ -607,31 +1116,7 @@ namespace json
 
             void encode_utf8(long pt, string &out)
             {
-                if (pt < 0)
-                    return;
-
-                if (pt < 0x80)
-                {
-                    out += static_cast<char>(pt);
-                }
-                else if (pt < 0x800)
-                {
-                    out += static_cast<char>((pt >> 6) | 0xC0);
-                    out += static_cast<char>((pt & 0x3F) | 0x80);
-                }
-                else if (pt < 0x10000)
-                {
-                    out += static_cast<char>((pt >> 12) | 0xE0);
-                    out += static_cast<char>(((pt >> 6) & 0x3F) | 0x80);
-                    out += static_cast<char>((pt & 0x3F) | 0x80);
-                }
-                else
-                {
-                    out += static_cast<char>((pt >> 18) | 0xF0);
-                    out += static_cast<char>(((pt >> 12) & 0x3F) | 0x80);
-                    out += static_cast<char>(((pt >> 6) & 0x3F) | 0x80);
-                    out += static_cast<char>((pt & 0x3F) | 0x80);
-                }
+                detail::encode_utf8(pt, out);
             }
 
             string parse_string()
@@ -643,6 +1128,16 @@ namespace json
                     if (i == str.size())
                         return fail("unexpected end of input in string", "");
 
+                    size_t run = simd::find_string_special(str.data() + i, str.size() - i);
+                    if (run > 0)
+                    {
+                        encode_utf8(last_escaped_codepoint, out);
+                        last_escaped_codepoint = -1;
+                        out.append(str, i, run);
+                        i += run;
+                        continue;
+                    }
+
                     char ch = str[i++];
 
                     if (ch == '"')
@@ -760,11 +1255,6 @@ namespace json
                     return fail("invalid " + esc(str[i]) + " in number");
                 }
 
-                if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
-                    && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10))
-                {
-                    return std::atoi(str.c_str() + start_pos);
-                }
 
                 if (str[i] == '.')
                 {
@@ -789,7 +1279,10 @@ namespace json
                     while (in_range(str[i], '0', '9'))
                         i++;
                 }
-                return std::strtod(str.c_str() + start_pos, nullptr);
+                detail::number value = detail::parse_number(str.data() + start_pos, str.data() + i);
+                if (value.is_integer)
+                    return value.integer;
+                return value.real;
             }
 
             JSON expect(const string &expected, JSON res)
@@ -838,10 +1331,10 @@ namespace json
 
                 if (ch == '{')
                 {
-                    map<string, JSON> data;
+                    vector<JSON::object::value_type> data;
                     ch = get_next_token();
                     if (ch == '}')
-                        return data;
+                        return JSON::object::adopt(std::move(data));
 
                     while (1)
                     {
@@ -856,7 +1349,7 @@ namespace json
                         if (ch != ':')
                             return fail("expected ':' in object, got " + esc(ch));
 
-                        data[std::move(key)] = parse_json(depth + 1);
+                        data.emplace_back(std::move(key), parse_json(depth + 1));
                         if (failed)
                             return JSON();
 
@@ -868,7 +1361,7 @@ namespace json
 
                         ch = get_next_token();
                     }
-                    return data;
+                    return JSON::object::adopt(std::move(data));
                 }
 
                 if (ch == '[')
@@ -902,6 +1395,232 @@ namespace json
         };
     }
 
+    namespace detail
+    {
+        static JSON parse_at(const string &in, size_t &pos, string &err, bool &failed)
+        {
+            json_parser parser{in, pos, err, failed, json_parse::STANDARD};
+            JSON result = parser.parse_json(0);
+            pos = parser.i;
+            failed = parser.failed;
+            return result;
+        }
+
+        char reader::peek()
+        {
+            while (m_pos < m_in.size()
+                   && (m_in[m_pos] == ' ' || m_in[m_pos] == '\r' || m_in[m_pos] == '\n' || m_in[m_pos] == '\t'))
+                m_pos++;
+            return m_pos < m_in.size() ? m_in[m_pos] : '\0';
+        }
+
+        bool reader::fail(string &&msg)
+        {
+            if (!m_failed)
+                m_err = std::move(msg);
+            m_failed = true;
+            return false;
+        }
+
+        bool reader::begin_object()
+        {
+            if (m_failed)
+                return false;
+            if (peek() != '{')
+            {
+                skip();
+                return false;
+            }
+            m_pos++;
+            return true;
+        }
+
+        bool reader::next_member(string &name, bool &first)
+        {
+            if (m_failed)
+                return false;
+
+            char ch = peek();
+            if (m_pos == m_in.size())
+                return fail("unexpected end of input");
+            if (ch == '}')
+            {
+                m_pos++;
+                return false;
+            }
+            if (!first)
+            {
+                if (ch != ',')
+                    return fail("expected ',' in object, got " + esc(ch));
+                m_pos++;
+                ch = peek();
+            }
+            if (ch != '"')
+                return fail("expected '\"' in object, got " + esc(ch));
+
+            if (!value(name))
+                return false;
+            if (peek() != ':')
+                return fail("expected ':' in object, got " + esc(m_in[m_pos]));
+            m_pos++;
+            first = false;
+            return true;
+        }
+
+        bool reader::begin_array()
+        {
+            if (m_failed)
+                return false;
+            if (peek() != '[')
+            {
+                skip();
+                return false;
+            }
+            m_pos++;
+            return true;
+        }
+
+        bool reader::next_element(bool &first)
+        {
+            if (m_failed)
+                return false;
+
+            char ch = peek();
+            if (m_pos == m_in.size())
+                return fail("unexpected end of input");
+            if (ch == ']')
+            {
+                m_pos++;
+                return false;
+            }
+            if (!first)
+            {
+                if (ch != ',')
+                    return fail("expected ',' in list, got " + esc(ch));
+                m_pos++;
+            }
+            first = false;
+            return true;
+        }
+
+        bool reader::value(bool &out)
+        {
+            char ch = peek();
+            if (ch != 't' && ch != 'f')
+            {
+                skip();
+                return false;
+            }
+            out = parse_at(m_in, m_pos, m_err, m_failed).bool_value();
+            return !m_failed;
+        }
+
+        bool reader::value(int64_t &out)
+        {
+            char ch = peek();
+            if (ch != '-' && !in_range(ch, '0', '9'))
+            {
+                skip();
+                return false;
+            }
+            out = parse_at(m_in, m_pos, m_err, m_failed).int64_value();
+            return !m_failed;
+        }
+
+        bool reader::value(double &out)
+        {
+            char ch = peek();
+            if (ch != '-' && !in_range(ch, '0', '9'))
+            {
+                skip();
+                return false;
+            }
+            out = parse_at(m_in, m_pos, m_err, m_failed).number_value();
+            return !m_failed;
+        }
+
+        bool reader::value(string &out)
+        {
+            if (peek() != '"')
+            {
+                skip();
+                return false;
+            }
+            json_parser parser{m_in, m_pos + 1, m_err, m_failed, json_parse::STANDARD};
+            out = parser.parse_string();
+            m_pos = parser.i;
+            m_failed = parser.failed;
+            return !m_failed;
+        }
+
+        bool reader::value(JSON &out)
+        {
+            out = parse_at(m_in, m_pos, m_err, m_failed);
+            return !m_failed;
+        }
+
+        bool reader::raw(std::string_view &out)
+        {
+            if (m_failed)
+                return false;
+
+            char ch = peek();
+            size_t begin = m_pos;
+            if (ch != '{' && ch != '[' && ch != '"')
+            {
+                skip();
+                out = std::string_view(m_in).substr(begin, m_pos - begin);
+                return !m_failed;
+            }
+
+            size_t depth = 0;
+            while (m_pos < m_in.size())
+            {
+                ch = m_in[m_pos++];
+                if (ch == '"')
+                {
+                    // Runs of plain text up to the next quote or backslash go by in one step.
+                    while (m_pos < m_in.size())
+                    {
+                        m_pos += simd::find_string_special(m_in.data() + m_pos, m_in.size() - m_pos);
+                        if (m_pos >= m_in.size() || m_in[m_pos] == '"')
+                            break;
+                        m_pos += m_in[m_pos] == '\\' ? 2 : 1;
+                    }
+                    if (m_pos >= m_in.size())
+                        break;
+                    m_pos++;
+                }
+                else if (ch == '{' || ch == '[')
+                {
+                    depth++;
+                }
+                else if (ch == '}' || ch == ']')
+                {
+                    depth--;
+                }
+                if (depth == 0)
+                {
+                    out = std::string_view(m_in).substr(begin, m_pos - begin);
+                    return true;
+                }
+            }
+            return fail("unexpected end of input");
+        }
+
+        void reader::skip()
+        {
+            parse_at(m_in, m_pos, m_err, m_failed);
+        }
+
+        bool reader::finish()
+        {
+            if (!m_failed && peek() != '\0')
+                fail("unexpected trailing " + esc(m_in[m_pos]));
+            return !m_failed;
+        }
+    }
+
     JSON JSON::parse(const std::string &in, std::string &err, json::json_parse strategy)
     {
         json_parser parser{in, 0, err, false, strategy};
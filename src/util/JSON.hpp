@@ -1,11 +1,13 @@
 #ifndef UTIL_JSON_HPP
 #define UTIL_JSON_HPP
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
 #include <memory>
 #include <initializer_list>
+#include <utility>
 
 namespace json
 {
@@ -16,6 +18,73 @@ namespace json
 
     class json_value;
 
+    class object_map;
+
+    // Name of an object member. Names are interned in a global table the first time they are seen, so
+    // equal interned names share one pointer and compare without touching the text. The table is
+    // insert-only and capped; names that do not fit keep their own copy and compare by text.
+    class key final
+    {
+    public:
+        key() noexcept;
+
+        key(std::string_view name);
+
+        key(const std::string &name) : key(std::string_view(name))
+        {}
+
+        key(const char *name) : key(std::string_view(name))
+        {}
+
+        key(const key &other);
+
+        key(key &&other) noexcept;
+
+        key &operator=(const key &other);
+
+        key &operator=(key &&other) noexcept;
+
+        ~key();
+
+        const std::string &str() const
+        {
+            return *m_str;
+        }
+
+        operator const std::string &() const
+        {
+            return *m_str;
+        }
+
+        bool interned() const
+        {
+            return !m_owned;
+        }
+
+        bool operator==(const key &rhs) const
+        {
+            if (m_str == rhs.m_str)
+                return true;
+            if (!m_owned && !rhs.m_owned)
+                return false;
+            return *m_str == *rhs.m_str;
+        }
+
+        bool operator!=(const key &rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+        bool operator<(const key &rhs) const
+        {
+            return m_str != rhs.m_str && *m_str < *rhs.m_str;
+        }
+
+    private:
+        const std::string *m_str;
+        bool m_owned;
+    };
+
     class JSON final
     {
     public:
@@ -25,16 +94,28 @@ namespace json
         };
 
         typedef std::vector<JSON> array;
-        typedef std::map<std::string, JSON> object;
+        typedef object_map object;
 
         JSON() noexcept;
 
         JSON(std::nullptr_t) noexcept;
 
+        JSON(const JSON &other);
+
+        JSON(JSON &&other) noexcept;
+
+        JSON &operator=(const JSON &other);
+
+        JSON &operator=(JSON &&other) noexcept;
+
+        ~JSON();
+
         JSON(double value);
 
         JSON(int value);
 
+        JSON(int64_t value);
+
         JSON(bool value);
 
         JSON(const std::string &value);
@@ -82,6 +163,12 @@ namespace json
             return type() == NUMBER;
         }
 
+        // A number held exactly as int64_t, as opposed to a double.
+        bool is_integer() const
+        {
+            return m_storage == INLINE_INT;
+        }
+
         bool is_bool() const
         {
             return type() == BOOL;
@@ -106,6 +193,8 @@ namespace json
 
         int int_value() const;
 
+        int64_t int64_value() const;
+
         bool bool_value() const;
 
         const std::string &string_value() const;
@@ -116,10 +205,23 @@ namespace json
 
         const JSON &operator[](size_t i) const;
 
-        const JSON &operator[](const std::string &key) const;
+        const JSON &operator[](const key &name) const;
+
+        // Copy-on-write access for patching in place. A container shared with another JSON is copied first,
+        // one level deep, so only the path being changed is duplicated; any other value is replaced by an
+        // empty container. The reference is good until this JSON is next copied or assigned.
+        array &mutable_array();
+
+        object &mutable_object();
+
+        JSON &set(const key &name, JSON value);
 
         void dump(std::string &out) const;
 
+        // Exact length of dump()'s output, for sizing a buffer or a length prefix up front. It walks the
+        // whole tree, so it only pays off where the output cannot simply grow.
+        size_t dump_size() const;
+
         std::string dump() const
         {
             std::string out;
@@ -182,19 +284,137 @@ namespace json
         bool has_shape(const shape &types, std::string &err) const;
 
     private:
-        std::shared_ptr<json_value> m_ptr;
+        // Scalars and strings that fit std::string's small buffer live in the handle itself; only long
+        // strings, arrays and objects are shared json_value nodes.
+        enum storage : uint8_t
+        {
+            INLINE_NUL, INLINE_BOOL, INLINE_INT, INLINE_DOUBLE, INLINE_STRING, HEAP
+        };
+
+        static const size_t inline_string_max = 15;
+
+        void init_string(std::string &&value);
+
+        void copy_from(const JSON &other);
+
+        void move_from(JSON &other) noexcept;
+
+        void destroy() noexcept;
+
+        storage m_storage;
+        union
+        {
+            bool m_bool;
+            int64_t m_int;
+            double m_double;
+            std::string m_str;
+            std::shared_ptr<json_value> m_ptr;
+        };
     };
 
 
+    // Object members in one vector sorted by name, so iteration and dump() keep std::map's order. Small
+    // objects are scanned, which with interned names is one pointer compare per member; larger ones are
+    // binary searched.
+    class object_map final
+    {
+    public:
+        typedef std::pair<key, JSON> value_type;
+        typedef std::vector<value_type>::iterator iterator;
+        typedef std::vector<value_type>::const_iterator const_iterator;
+
+        object_map()
+        {}
+
+        // As with std::map, the first of several equal names is kept.
+        object_map(std::initializer_list<value_type> items) : m_items(items)
+        {
+            normalize(false);
+        }
+
+        template<class It>
+        object_map(It first, It last) : m_items(first, last)
+        {
+            normalize(false);
+        }
+
+        // Takes members in any order; the last of several equal names wins, as when parsing.
+        static object_map adopt(std::vector<value_type> &&members);
+
+        iterator begin()
+        {
+            return m_items.begin();
+        }
+
+        iterator end()
+        {
+            return m_items.end();
+        }
+
+        const_iterator begin() const
+        {
+            return m_items.begin();
+        }
+
+        const_iterator end() const
+        {
+            return m_items.end();
+        }
+
+        size_t size() const
+        {
+            return m_items.size();
+        }
+
+        bool empty() const
+        {
+            return m_items.empty();
+        }
+
+        void reserve(size_t n)
+        {
+            m_items.reserve(n);
+        }
+
+        iterator find(const key &name);
+
+        const_iterator find(const key &name) const;
+
+        size_t count(const key &name) const
+        {
+            return find(name) != end() ? 1 : 0;
+        }
+
+        JSON &operator[](const key &name);
+
+        std::pair<iterator, bool> emplace(key name, JSON value);
+
+        std::pair<iterator, bool> insert(value_type item)
+        {
+            return emplace(std::move(item.first), std::move(item.second));
+        }
+
+        size_t erase(const key &name);
+
+        bool operator==(const object_map &rhs) const;
+
+        bool operator<(const object_map &rhs) const;
+
+    private:
+        static const size_t linear_max = 8;
+
+        void normalize(bool keep_last);
+
+        iterator lower_bound(const key &name);
+
+        std::vector<value_type> m_items;
+    };
+
     class json_value
     {
     protected:
         friend class JSON;
 
-        friend class json_int;
-
-        friend class json_double;
-
         virtual JSON::json_type type() const = 0;
 
         virtual bool equals(const json_value *other) const = 0;
@@ -203,6 +423,8 @@ namespace json
 
         virtual void dump(std::string &out) const = 0;
 
+        virtual size_t dump_size() const = 0;
+
         virtual double number_value() const;
 
         virtual int int_value() const;
@@ -217,7 +439,7 @@ namespace json
 
         virtual const JSON::object &object_items() const;
 
-        virtual const JSON &operator[](const std::string &key) const;
+        virtual const JSON &operator[](const key &name) const;
 
         virtual ~json_value()
         {}
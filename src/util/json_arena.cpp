@@ -0,0 +1,721 @@
+#include "json_arena.hpp"
+#include "json_detail.hpp"
+#include "json_simd.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+namespace json
+{
+    static const int max_depth = 200;
+
+    static_assert(std::is_trivially_copyable<arena_json>::value, "arena_json is copied with memcpy");
+    static_assert(std::is_trivially_copyable<arena_json::member>::value, "members are copied with memcpy");
+
+    using detail::esc;
+
+    arena::arena() noexcept :
+            m_cur(m_inline), m_end(m_inline + inline_size), m_blocks(nullptr), m_next_block_size(min_block_size)
+    {
+    }
+
+    arena::~arena()
+    {
+        reset();
+    }
+
+    void *arena::allocate(const size_t size, const size_t align)
+    {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(m_cur) + align - 1) & ~(uintptr_t(align) - 1);
+        if (aligned + size <= reinterpret_cast<uintptr_t>(m_end))
+        {
+            m_cur = reinterpret_cast<char *>(aligned + size);
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        size_t block_size = std::max(m_next_block_size, sizeof(block) + size + align);
+        block *b = static_cast<block *>(malloc(block_size));
+        if (b == nullptr)
+            throw std::bad_alloc();
+        b->next = m_blocks;
+        b->size = block_size;
+        m_blocks = b;
+        m_next_block_size = block_size * 2;
+
+        m_cur = reinterpret_cast<char *>(b + 1);
+        m_end = reinterpret_cast<char *>(b) + block_size;
+        return allocate(size, align);
+    }
+
+    std::string_view arena::copy(std::string_view str)
+    {
+        if (str.empty())
+            return std::string_view();
+        char *data = allocate_array<char>(str.size());
+        memcpy(data, str.data(), str.size());
+        return std::string_view(data, str.size());
+    }
+
+    void arena::reset()
+    {
+        while (m_blocks != nullptr)
+        {
+            block *next = m_blocks->next;
+            free(m_blocks);
+            m_blocks = next;
+        }
+        m_cur = m_inline;
+        m_end = m_inline + inline_size;
+        m_next_block_size = min_block_size;
+    }
+
+    // Grows by doubling inside the arena; the abandoned copies are reclaimed with everything else.
+    template<typename T>
+    struct arena_list
+    {
+        arena &a;
+        T *data;
+        uint32_t size;
+        uint32_t capacity;
+
+        explicit arena_list(arena &a) : a(a), data(nullptr), size(0), capacity(0)
+        {}
+
+        void push_back(const T &value)
+        {
+            if (size == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 8;
+                T *grown = a.allocate_array<T>(capacity);
+                if (size)
+                    memcpy(static_cast<void *>(grown), data, sizeof(T) * size);
+                data = grown;
+            }
+            data[size++] = value;
+        }
+    };
+
+    arena_json::arena_json(arena &a, std::string_view value) : m_kind(STRING), m_size(0), m_str(nullptr)
+    {
+        std::string_view copy = a.copy(value);
+        m_str = copy.data();
+        m_size = static_cast<uint32_t>(copy.size());
+    }
+
+    arena_json arena_json::make_array(const arena_json *items, const uint32_t size)
+    {
+        arena_json result;
+        result.m_kind = ARRAY;
+        result.m_size = size;
+        result.m_items = items;
+        return result;
+    }
+
+    arena_json arena_json::make_object(arena &a, member *members, uint32_t size)
+    {
+        // Sort positions rather than members so equal keys keep their input order and the last one wins.
+        uint32_t *order = a.allocate_array<uint32_t>(size);
+        for (uint32_t i = 0; i < size; i++)
+            order[i] = i;
+        std::sort(order, order + size, [members](uint32_t lhs, uint32_t rhs)
+        {
+            int cmp = members[lhs].key.compare(members[rhs].key);
+            return cmp < 0 || (cmp == 0 && lhs < rhs);
+        });
+
+        member *sorted = a.allocate_array<member>(size);
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            const member &m = members[order[i]];
+            if (n > 0 && sorted[n - 1].key == m.key)
+                sorted[n - 1] = m;
+            else
+                sorted[n++] = m;
+        }
+
+        arena_json result;
+        result.m_kind = OBJECT;
+        result.m_size = n;
+        result.m_members = sorted;
+        return result;
+    }
+
+    arena_json arena_json::array(arena &a, std::initializer_list<arena_json> items)
+    {
+        arena_json *data = a.allocate_array<arena_json>(items.size());
+        std::copy(items.begin(), items.end(), data);
+        return make_array(data, static_cast<uint32_t>(items.size()));
+    }
+
+    arena_json arena_json::object(arena &a, std::initializer_list<std::pair<std::string_view, arena_json>> members)
+    {
+        member *data = a.allocate_array<member>(members.size());
+        uint32_t n = 0;
+        for (const auto &kv : members)
+            data[n++] = member{a.copy(kv.first), kv.second};
+        return make_object(a, data, n);
+    }
+
+    JSON::json_type arena_json::type() const
+    {
+        switch (m_kind)
+        {
+            case BOOL:
+                return JSON::BOOL;
+            case INT:
+            case DOUBLE:
+                return JSON::NUMBER;
+            case STRING:
+                return JSON::STRING;
+            case ARRAY:
+                return JSON::ARRAY;
+            case OBJECT:
+                return JSON::OBJECT;
+            default:
+                return JSON::NUL;
+        }
+    }
+
+    double arena_json::number_value() const
+    {
+        if (m_kind == INT)
+            return static_cast<double>(m_int);
+        return m_kind == DOUBLE ? m_double : 0;
+    }
+
+    int arena_json::int_value() const
+    {
+        if (m_kind == DOUBLE)
+            return detail::truncate_int(m_double);
+        return m_kind == INT ? static_cast<int>(m_int) : 0;
+    }
+
+    int64_t arena_json::int64_value() const
+    {
+        if (m_kind == DOUBLE)
+            return detail::truncate_int64(m_double);
+        return m_kind == INT ? m_int : 0;
+    }
+
+    bool arena_json::bool_value() const
+    {
+        return m_kind == BOOL && m_bool;
+    }
+
+    std::string_view arena_json::string_value() const
+    {
+        return m_kind == STRING ? std::string_view(m_str, m_size) : std::string_view();
+    }
+
+    size_t arena_json::size() const
+    {
+        return m_kind == ARRAY || m_kind == OBJECT ? m_size : 0;
+    }
+
+    const arena_json *arena_json::items() const
+    {
+        return m_kind == ARRAY ? m_items : nullptr;
+    }
+
+    const arena_json::member *arena_json::members() const
+    {
+        return m_kind == OBJECT ? m_members : nullptr;
+    }
+
+    arena_json arena_json::operator[](size_t i) const
+    {
+        if (m_kind != ARRAY || i >= m_size)
+            return arena_json();
+        return m_items[i];
+    }
+
+    arena_json arena_json::operator[](std::string_view key) const
+    {
+        if (m_kind != OBJECT)
+            return arena_json();
+
+        const member *end = m_members + m_size;
+        const member *iter = std::lower_bound(m_members, end, key, [](const member &m, std::string_view k)
+        {
+            return m.key < k;
+        });
+        return (iter != end && iter->key == key) ? iter->value : arena_json();
+    }
+
+    void arena_json::dump(std::string &out) const
+    {
+        switch (m_kind)
+        {
+            case NUL:
+                out += "null";
+                break;
+            case BOOL:
+                out += m_bool ? "true" : "false";
+                break;
+            case INT:
+                detail::dump_number(m_int, out);
+                break;
+            case DOUBLE:
+                detail::dump_number(m_double, out);
+                break;
+            case STRING:
+                detail::dump_string(string_value(), out);
+                break;
+            case ARRAY:
+                out += "[";
+                for (uint32_t i = 0; i < m_size; i++)
+                {
+                    if (i)
+                        out += ", ";
+                    m_items[i].dump(out);
+                }
+                out += "]";
+                break;
+            case OBJECT:
+                out += "{";
+                for (uint32_t i = 0; i < m_size; i++)
+                {
+                    if (i)
+                        out += ", ";
+                    detail::dump_string(m_members[i].key, out);
+                    out += ": ";
+                    m_members[i].value.dump(out);
+                }
+                out += "}";
+                break;
+        }
+    }
+
+    size_t arena_json::dump_size() const
+    {
+        size_t size = 0;
+        switch (m_kind)
+        {
+            case NUL:
+                return 4;
+            case BOOL:
+                return m_bool ? 4 : 5;
+            case INT:
+                return detail::number_size(m_int);
+            case DOUBLE:
+                return detail::number_size(m_double);
+            case STRING:
+                return detail::string_size(string_value());
+            case ARRAY:
+                size = m_size ? m_size * 2 : 2;
+                for (uint32_t i = 0; i < m_size; i++)
+                    size += m_items[i].dump_size();
+                return size;
+            case OBJECT:
+                size = m_size ? m_size * 4 : 2;
+                for (uint32_t i = 0; i < m_size; i++)
+                    size += detail::string_size(m_members[i].key) + m_members[i].value.dump_size();
+                return size;
+        }
+        return size;
+    }
+
+    JSON arena_json::to_json() const
+    {
+        switch (m_kind)
+        {
+            case BOOL:
+                return m_bool;
+            case INT:
+                return m_int;
+            case DOUBLE:
+                return m_double;
+            case STRING:
+                return std::string(m_str, m_size);
+            case ARRAY:
+            {
+                JSON::array values;
+                values.reserve(m_size);
+                for (uint32_t i = 0; i < m_size; i++)
+                    values.push_back(m_items[i].to_json());
+                return values;
+            }
+            case OBJECT:
+            {
+                JSON::object values;
+                for (uint32_t i = 0; i < m_size; i++)
+                    values.emplace(std::string(m_members[i].key), m_members[i].value.to_json());
+                return values;
+            }
+            default:
+                return JSON();
+        }
+    }
+
+    // Same grammar and error messages as the parser behind JSON::parse (STANDARD strategy), building into
+    // an arena instead of shared nodes.
+    struct arena_parser final
+    {
+        arena &a;
+        const char *p;
+        const char *end;
+        std::string &err;
+        bool failed;
+
+        arena_json fail(std::string &&msg)
+        {
+            if (!failed)
+                err = std::move(msg);
+            failed = true;
+            return arena_json();
+        }
+
+        char peek() const
+        {
+            return p < end ? *p : '\0';
+        }
+
+        void consume_whitespace()
+        {
+            while (p < end && (*p == ' ' || *p == '\r' || *p == '\n' || *p == '\t'))
+                p++;
+        }
+
+        char get_next_token()
+        {
+            consume_whitespace();
+            if (p == end)
+            {
+                fail("unexpected end of input");
+                return 0;
+            }
+            return *p++;
+        }
+
+        static char *encode_utf8(long pt, char *out)
+        {
+            if (pt < 0)
+                return out;
+
+            if (pt < 0x80)
+            {
+                *out++ = static_cast<char>(pt);
+            }
+            else if (pt < 0x800)
+            {
+                *out++ = static_cast<char>((pt >> 6) | 0xC0);
+                *out++ = static_cast<char>((pt & 0x3F) | 0x80);
+            }
+            else if (pt < 0x10000)
+            {
+                *out++ = static_cast<char>((pt >> 12) | 0xE0);
+                *out++ = static_cast<char>(((pt >> 6) & 0x3F) | 0x80);
+                *out++ = static_cast<char>((pt & 0x3F) | 0x80);
+            }
+            else
+            {
+                *out++ = static_cast<char>((pt >> 18) | 0xF0);
+                *out++ = static_cast<char>(((pt >> 12) & 0x3F) | 0x80);
+                *out++ = static_cast<char>(((pt >> 6) & 0x3F) | 0x80);
+                *out++ = static_cast<char>((pt & 0x3F) | 0x80);
+            }
+            return out;
+        }
+
+        static bool is_hex(char ch)
+        {
+            return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+        }
+
+        // p is just past the opening quote. A decoded string is never longer than its escaped form, so the
+        // arena buffer is sized from the raw length.
+        bool parse_string(std::string_view &out)
+        {
+            size_t run = simd::find_string_special(p, static_cast<size_t>(end - p));
+            if (p + run < end && p[run] == '"')
+            {
+                out = a.copy(std::string_view(p, run));
+                p += run + 1;
+                return true;
+            }
+
+            char *buf = a.allocate_array<char>(static_cast<size_t>(end - p) + 1);
+            char *o = buf;
+            long last_escaped_codepoint = -1;
+            while (true)
+            {
+                if (p == end)
+                    return fail("unexpected end of input in string"), false;
+
+                run = simd::find_string_special(p, static_cast<size_t>(end - p));
+                if (run > 0)
+                {
+                    o = encode_utf8(last_escaped_codepoint, o);
+                    last_escaped_codepoint = -1;
+                    memcpy(o, p, run);
+                    o += run;
+                    p += run;
+                    continue;
+                }
+
+                char ch = *p++;
+                if (ch == '"')
+                {
+                    o = encode_utf8(last_escaped_codepoint, o);
+                    out = std::string_view(buf, static_cast<size_t>(o - buf));
+                    return true;
+                }
+
+                if (ch != '\\')
+                    return fail("unescaped " + esc(ch) + " in string"), false;
+
+                if (p == end)
+                    return fail("unexpected end of input in string"), false;
+
+                ch = *p++;
+                if (ch == 'u')
+                {
+                    std::string hex(p, std::min<size_t>(4, static_cast<size_t>(end - p)));
+                    if (hex.length() < 4)
+                        return fail("bad \\u escape: " + hex), false;
+                    for (size_t j = 0; j < 4; j++)
+                    {
+                        if (!is_hex(hex[j]))
+                            return fail("bad \\u escape: " + hex), false;
+                    }
+
+                    long codepoint = strtol(hex.c_str(), nullptr, 16);
+                    if (last_escaped_codepoint >= 0xD800 && last_escaped_codepoint <= 0xDBFF
+                        && codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+                    {
+                        o = encode_utf8((((last_escaped_codepoint - 0xD800) << 10) | (codepoint - 0xDC00)) + 0x10000, o);
+                        last_escaped_codepoint = -1;
+                    }
+                    else
+                    {
+                        o = encode_utf8(last_escaped_codepoint, o);
+                        last_escaped_codepoint = codepoint;
+                    }
+                    p += 4;
+                    continue;
+                }
+
+                o = encode_utf8(last_escaped_codepoint, o);
+                last_escaped_codepoint = -1;
+
+                switch (ch)
+                {
+                    case 'b':
+                        *o++ = '\b';
+                        break;
+                    case 'f':
+                        *o++ = '\f';
+                        break;
+                    case 'n':
+                        *o++ = '\n';
+                        break;
+                    case 'r':
+                        *o++ = '\r';
+                        break;
+                    case 't':
+                        *o++ = '\t';
+                        break;
+                    case '"':
+                    case '\\':
+                    case '/':
+                        *o++ = ch;
+                        break;
+                    default:
+                        return fail("invalid escape character " + esc(ch)), false;
+                }
+            }
+        }
+
+        static bool is_digit(char ch)
+        {
+            return ch >= '0' && ch <= '9';
+        }
+
+        arena_json parse_number()
+        {
+            const char *start = p;
+
+            if (peek() == '-')
+                p++;
+
+            if (peek() == '0')
+            {
+                p++;
+                if (is_digit(peek()))
+                    return fail("leading 0s not permitted in numbers");
+            }
+            else if (peek() >= '1' && peek() <= '9')
+            {
+                p++;
+                while (is_digit(peek()))
+                    p++;
+            }
+            else
+            {
+                return fail("invalid " + esc(peek()) + " in number");
+            }
+
+            if (peek() == '.')
+            {
+                p++;
+                if (!is_digit(peek()))
+                    return fail("at least one digit required in fractional part");
+                while (is_digit(peek()))
+                    p++;
+            }
+
+            if (peek() == 'e' || peek() == 'E')
+            {
+                p++;
+                if (peek() == '+' || peek() == '-')
+                    p++;
+                if (!is_digit(peek()))
+                    return fail("at least one digit required in exponent");
+                while (is_digit(peek()))
+                    p++;
+            }
+
+            detail::number value = detail::parse_number(start, p);
+            if (value.is_integer)
+                return value.integer;
+            return value.real;
+        }
+
+        arena_json expect(const char *expected, arena_json res)
+        {
+            p--;
+            size_t len = strlen(expected);
+            if (static_cast<size_t>(end - p) >= len && memcmp(p, expected, len) == 0)
+            {
+                p += len;
+                return res;
+            }
+            return fail("parse error: expected " + std::string(expected) + ", got "
+                        + std::string(p, std::min(len, static_cast<size_t>(end - p))));
+        }
+
+        arena_json parse_json(int depth)
+        {
+            if (depth > max_depth)
+                return fail("exceeded maximum nesting depth");
+
+            char ch = get_next_token();
+            if (failed)
+                return arena_json();
+
+            if (ch == '-' || (ch >= '0' && ch <= '9'))
+            {
+                p--;
+                return parse_number();
+            }
+
+            if (ch == 't')
+                return expect("true", true);
+
+            if (ch == 'f')
+                return expect("false", false);
+
+            if (ch == 'n')
+                return expect("null", arena_json());
+
+            if (ch == '"')
+            {
+                std::string_view str;
+                if (!parse_string(str))
+                    return arena_json();
+                arena_json result;
+                result.m_kind = arena_json::STRING;
+                result.m_size = static_cast<uint32_t>(str.size());
+                result.m_str = str.data();
+                return result;
+            }
+
+            if (ch == '{')
+            {
+                arena_list<arena_json::member> data(a);
+                ch = get_next_token();
+                if (ch == '}')
+                    return arena_json::make_object(a, data.data, data.size);
+
+                while (1)
+                {
+                    if (ch != '"')
+                        return fail("expected '\"' in object, got " + esc(ch));
+
+                    std::string_view key;
+                    if (!parse_string(key))
+                        return arena_json();
+
+                    ch = get_next_token();
+                    if (ch != ':')
+                        return fail("expected ':' in object, got " + esc(ch));
+
+                    arena_json value = parse_json(depth + 1);
+                    if (failed)
+                        return arena_json();
+                    data.push_back(arena_json::member{key, value});
+
+                    ch = get_next_token();
+                    if (ch == '}')
+                        break;
+                    if (ch != ',')
+                        return fail("expected ',' in object, got " + esc(ch));
+
+                    ch = get_next_token();
+                }
+                return arena_json::make_object(a, data.data, data.size);
+            }
+
+            if (ch == '[')
+            {
+                arena_list<arena_json> data(a);
+                ch = get_next_token();
+                if (ch == ']')
+                    return arena_json::make_array(data.data, data.size);
+
+                while (1)
+                {
+                    p--;
+                    data.push_back(parse_json(depth + 1));
+                    if (failed)
+                        return arena_json();
+
+                    ch = get_next_token();
+                    if (ch == ']')
+                        break;
+                    if (ch != ',')
+                        return fail("expected ',' in list, got " + esc(ch));
+
+                    ch = get_next_token();
+                    (void) ch;
+                }
+                return arena_json::make_array(data.data, data.size);
+            }
+
+            return fail("expected value, got " + esc(ch));
+        }
+    };
+
+    arena_json arena_json::parse(arena &a, std::string_view in, std::string &err)
+    {
+        if (in.size() >= std::numeric_limits<uint32_t>::max())
+        {
+            err = "input too large";
+            return arena_json();
+        }
+
+        arena_parser parser{a, in.data(), in.data() + in.size(), err, false};
+        arena_json result = parser.parse_json(0);
+        parser.consume_whitespace();
+        if (parser.failed)
+            return arena_json();
+        if (parser.p != parser.end)
+            return parser.fail("unexpected trailing " + esc(*parser.p));
+        return result;
+    }
+}
@@ -0,0 +1,199 @@
+#ifndef UTIL_JSON_ARENA_HPP
+#define UTIL_JSON_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <util/JSON.hpp>
+
+namespace json
+{
+    // Bump allocator that owns every node of one message. The first kilobyte lives inside the arena itself,
+    // so a stack arena holding a typical payload never touches malloc; larger trees spill into heap blocks.
+    // Everything is released at once by reset() or the destructor.
+    class arena final
+    {
+    public:
+        arena() noexcept;
+
+        ~arena();
+
+        arena(const arena &) = delete;
+
+        arena &operator=(const arena &) = delete;
+
+        void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+        template<typename T>
+        T *allocate_array(size_t n)
+        {
+            return static_cast<T *>(allocate(sizeof(T) * n, alignof(T)));
+        }
+
+        std::string_view copy(std::string_view str);
+
+        void reset();
+
+    private:
+        struct block
+        {
+            block *next;
+            size_t size;
+        };
+
+        static const size_t inline_size = 1024;
+        static const size_t min_block_size = 4096;
+
+        char *m_cur;
+        char *m_end;
+        block *m_blocks;
+        size_t m_next_block_size;
+        alignas(std::max_align_t) char m_inline[inline_size];
+    };
+
+    // Value in an arena-allocated DOM. Scalars are held inline; strings, arrays and objects point into the
+    // arena. Handles are trivially copyable, so passing them around costs no refcount traffic at all, but
+    // they must not outlive their arena and are meant for single-threaded use. Object members are kept
+    // sorted by key with the last duplicate winning, so dump() matches JSON::dump byte for byte.
+    class arena_json final
+    {
+    public:
+        struct member;
+
+        arena_json() noexcept : m_kind(NUL), m_size(0), m_int(0)
+        {}
+
+        arena_json(std::nullptr_t) noexcept : arena_json()
+        {}
+
+        arena_json(bool value) noexcept : m_kind(BOOL), m_size(0), m_bool(value)
+        {}
+
+        arena_json(int value) noexcept : m_kind(INT), m_size(0), m_int(value)
+        {}
+
+        arena_json(int64_t value) noexcept : m_kind(INT), m_size(0), m_int(value)
+        {}
+
+        arena_json(double value) noexcept : m_kind(DOUBLE), m_size(0), m_double(value)
+        {}
+
+        arena_json(arena &a, std::string_view value);
+
+        arena_json(const char *) = delete;
+
+        arena_json(void *) = delete;
+
+        static arena_json array(arena &a, std::initializer_list<arena_json> items);
+
+        static arena_json object(arena &a, std::initializer_list<std::pair<std::string_view, arena_json>> members);
+
+        static arena_json parse(arena &a, std::string_view in, std::string &err);
+
+        JSON::json_type type() const;
+
+        bool is_null() const
+        {
+            return m_kind == NUL;
+        }
+
+        bool is_number() const
+        {
+            return m_kind == INT || m_kind == DOUBLE;
+        }
+
+        bool is_integer() const
+        {
+            return m_kind == INT;
+        }
+
+        bool is_bool() const
+        {
+            return m_kind == BOOL;
+        }
+
+        bool is_string() const
+        {
+            return m_kind == STRING;
+        }
+
+        bool is_array() const
+        {
+            return m_kind == ARRAY;
+        }
+
+        bool is_object() const
+        {
+            return m_kind == OBJECT;
+        }
+
+        double number_value() const;
+
+        int int_value() const;
+
+        int64_t int64_value() const;
+
+        bool bool_value() const;
+
+        std::string_view string_value() const;
+
+        size_t size() const;
+
+        const arena_json *items() const;
+
+        const member *members() const;
+
+        arena_json operator[](size_t i) const;
+
+        arena_json operator[](std::string_view key) const;
+
+        void dump(std::string &out) const;
+
+        size_t dump_size() const;
+
+        std::string dump() const
+        {
+            std::string out;
+            dump(out);
+            return out;
+        }
+
+        JSON to_json() const;
+
+    private:
+        enum kind : uint8_t
+        {
+            NUL, BOOL, INT, DOUBLE, STRING, ARRAY, OBJECT
+        };
+
+        friend struct arena_parser;
+
+        static arena_json make_array(const arena_json *items, uint32_t size);
+
+        static arena_json make_object(arena &a, member *members, uint32_t size);
+
+        kind m_kind;
+        uint32_t m_size;
+        union
+        {
+            bool m_bool;
+            int64_t m_int;
+            double m_double;
+            const char *m_str;
+            const arena_json *m_items;
+            const member *m_members;
+        };
+    };
+
+    struct arena_json::member
+    {
+        std::string_view key;
+        arena_json value;
+    };
+}
+
+#endif //UTIL_JSON_ARENA_HPP
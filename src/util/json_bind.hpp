@@ -0,0 +1,401 @@
+#ifndef UTIL_JSON_BIND_HPP
+#define UTIL_JSON_BIND_HPP
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <util/JSON.hpp>
+#include <util/json_detail.hpp>
+
+// Binds a struct to a JSON object by listing its fields once:
+//
+//     struct point
+//     {
+//         int x;
+//         int y;
+//
+//         static constexpr auto json_fields()
+//         {
+//             return std::make_tuple(json::field("x", &point::x), json::field("y", &point::y));
+//         }
+//     };
+//
+// write() emits the object straight from the members and read() fills them straight from the text, with
+// no JSON tree in between. Fields are written in the order listed, so listing them by name gives the
+// bytes JSON::dump would. On input, missing members keep their value, members of another type and unknown
+// members are skipped, and the last of duplicate members wins. Malformed input makes read() return false
+// and may leave the struct partly filled. Empty std::optional fields are left out. Field types may be
+// bool, int, int64_t, double, std::string, JSON, lazy_json, std::vector and std::optional of those, and
+// other bound structs.
+namespace json
+{
+    // A field kept as its JSON text until first asked for, for values that are usually passed along unread.
+    // Copies share the text, and writing an untouched value copies the text back out. Content that is not
+    // valid JSON is caught only when decoded, and decodes as null.
+    class lazy_json
+    {
+    public:
+        lazy_json() : m_decoded(true)
+        {}
+
+        lazy_json(JSON value) : m_value(std::move(value)), m_decoded(true)
+        {}
+
+        static lazy_json from_text(std::string_view text)
+        {
+            lazy_json result;
+            result.m_text = std::make_shared<const std::string>(text);
+            result.m_decoded = false;
+            return result;
+        }
+
+        bool decoded() const
+        {
+            return m_decoded;
+        }
+
+        const JSON &get() const
+        {
+            if (!m_decoded)
+            {
+                std::string err;
+                m_value = JSON::parse(*m_text, err);
+                m_decoded = true;
+            }
+            return m_value;
+        }
+
+        // Decodes if needed and lets go of the text, since the value may now change.
+        JSON &get_mutable()
+        {
+            get();
+            m_text.reset();
+            return m_value;
+        }
+
+        void write(std::string &out) const
+        {
+            if (m_text)
+                out += *m_text;
+            else
+                m_value.dump(out);
+        }
+
+    private:
+        std::shared_ptr<const std::string> m_text;
+        mutable JSON m_value;
+        mutable bool m_decoded;
+    };
+
+    template<class C, class T>
+    struct field_def
+    {
+        const char *name;
+        T C::*member;
+    };
+
+    template<class C, class T>
+    constexpr field_def<C, T> field(const char *name, T C::*member)
+    {
+        return field_def<C, T>{name, member};
+    }
+
+    template<class T, class = void>
+    struct is_bound : std::false_type
+    {
+    };
+
+    template<class T>
+    struct is_bound<T, std::void_t<decltype(T::json_fields())>> : std::true_type
+    {
+    };
+
+    namespace detail
+    {
+        template<class T>
+        void write_value(const std::vector<T> &values, std::string &out);
+
+        template<class T>
+        typename std::enable_if<is_bound<T>::value>::type write_value(const T &value, std::string &out);
+
+        template<class T>
+        bool read_value(reader &in, std::vector<T> &out);
+
+        template<class T>
+        bool read_value(reader &in, std::optional<T> &out);
+
+        template<class T>
+        typename std::enable_if<is_bound<T>::value, bool>::type read_value(reader &in, T &out);
+
+        template<class T>
+        JSON to_dom(const std::vector<T> &values);
+
+        template<class T>
+        typename std::enable_if<is_bound<T>::value, JSON>::type to_dom(const T &value);
+
+        inline void write_value(bool value, std::string &out)
+        {
+            out += value ? "true" : "false";
+        }
+
+        inline void write_value(int value, std::string &out)
+        {
+            dump_number(value, out);
+        }
+
+        inline void write_value(int64_t value, std::string &out)
+        {
+            dump_number(value, out);
+        }
+
+        inline void write_value(double value, std::string &out)
+        {
+            dump_number(value, out);
+        }
+
+        inline void write_value(const std::string &value, std::string &out)
+        {
+            dump_string(value, out);
+        }
+
+        inline void write_value(const JSON &value, std::string &out)
+        {
+            value.dump(out);
+        }
+
+        inline void write_value(const lazy_json &value, std::string &out)
+        {
+            value.write(out);
+        }
+
+        template<class T>
+        void write_value(const std::vector<T> &values, std::string &out)
+        {
+            out += '[';
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                if (i)
+                    out += ", ";
+                write_value(values[i], out);
+            }
+            out += ']';
+        }
+
+        template<class T>
+        void write_member(const char *name, const T &value, bool &first, std::string &out)
+        {
+            if (!first)
+                out += ", ";
+            first = false;
+            dump_string(name, out);
+            out += ": ";
+            write_value(value, out);
+        }
+
+        template<class T>
+        void write_member(const char *name, const std::optional<T> &value, bool &first, std::string &out)
+        {
+            if (value)
+                write_member(name, *value, first, out);
+        }
+
+        template<class T>
+        typename std::enable_if<is_bound<T>::value>::type write_value(const T &value, std::string &out)
+        {
+            out += '{';
+            bool first = true;
+            std::apply([&](const auto &... fields)
+                       {
+                           (write_member(fields.name, value.*(fields.member), first, out), ...);
+                       }, T::json_fields());
+            out += '}';
+        }
+
+        inline bool read_value(reader &in, bool &out)
+        {
+            return in.value(out);
+        }
+
+        inline bool read_value(reader &in, int &out)
+        {
+            int64_t value;
+            if (!in.value(value))
+                return false;
+            out = static_cast<int>(value);
+            return true;
+        }
+
+        inline bool read_value(reader &in, int64_t &out)
+        {
+            return in.value(out);
+        }
+
+        inline bool read_value(reader &in, double &out)
+        {
+            return in.value(out);
+        }
+
+        inline bool read_value(reader &in, std::string &out)
+        {
+            return in.value(out);
+        }
+
+        inline bool read_value(reader &in, JSON &out)
+        {
+            return in.value(out);
+        }
+
+        inline bool read_value(reader &in, lazy_json &out)
+        {
+            std::string_view text;
+            if (!in.raw(text))
+                return false;
+            out = lazy_json::from_text(text);
+            return true;
+        }
+
+        template<class T>
+        bool read_value(reader &in, std::vector<T> &out)
+        {
+            if (!in.begin_array())
+                return false;
+            out.clear();
+            bool first = true;
+            while (in.next_element(first))
+            {
+                out.emplace_back();
+                read_value(in, out.back());
+            }
+            return !in.failed();
+        }
+
+        template<class T>
+        bool read_value(reader &in, std::optional<T> &out)
+        {
+            T value{};
+            if (!read_value(in, value))
+                return false;
+            out = std::move(value);
+            return true;
+        }
+
+        template<class T>
+        typename std::enable_if<is_bound<T>::value, bool>::type read_value(reader &in, T &out)
+        {
+            if (!in.begin_object())
+                return false;
+
+            auto fields = T::json_fields();
+            std::string name;
+            bool first = true;
+            while (in.next_member(name, first))
+            {
+                bool matched = false;
+                std::apply([&](const auto &... f)
+                           {
+                               ((matched || name != f.name || (read_value(in, out.*(f.member)), matched = true)),
+                                       ...);
+                           }, fields);
+                if (!matched)
+                    in.skip();
+            }
+            return !in.failed();
+        }
+
+        template<class T>
+        typename std::enable_if<!is_bound<T>::value, JSON>::type to_dom(const T &value)
+        {
+            return JSON(value);
+        }
+
+        inline JSON to_dom(const lazy_json &value)
+        {
+            return value.get();
+        }
+
+        template<class T>
+        JSON to_dom(const std::vector<T> &values)
+        {
+            JSON::array items;
+            items.reserve(values.size());
+            for (const T &value : values)
+                items.push_back(to_dom(value));
+            return items;
+        }
+
+        template<class T>
+        void dom_member(JSON::object &members, const char *name, const T &value)
+        {
+            members.emplace(name, to_dom(value));
+        }
+
+        template<class T>
+        void dom_member(JSON::object &members, const char *name, const std::optional<T> &value)
+        {
+            if (value)
+                dom_member(members, name, *value);
+        }
+
+        template<class T>
+        typename std::enable_if<is_bound<T>::value, JSON>::type to_dom(const T &value)
+        {
+            JSON::object members;
+            std::apply([&](const auto &... fields)
+                       {
+                           (dom_member(members, fields.name, value.*(fields.member)), ...);
+                       }, T::json_fields());
+            return members;
+        }
+    }
+
+    template<class T>
+    void write(const T &value, std::string &out)
+    {
+        detail::write_value(value, out);
+    }
+
+    template<class T>
+    std::string write(const T &value)
+    {
+        std::string out;
+        detail::write_value(value, out);
+        return out;
+    }
+
+    template<class T>
+    bool read(const std::string &in, T &out, std::string &err)
+    {
+        detail::reader parser(in);
+        bool matched = detail::read_value(parser, out);
+        if (!parser.finish())
+        {
+            err = parser.error();
+            return false;
+        }
+        if (!matched)
+            err = "value does not match the bound type";
+        return matched;
+    }
+
+    template<class T>
+    bool read(const std::string &in, T &out)
+    {
+        std::string err;
+        return read(in, out, err);
+    }
+
+    // For the places that still want a tree, such as JSON content fields.
+    template<class T>
+    JSON to_json(const T &value)
+    {
+        return detail::to_dom(value);
+    }
+}
+
+#endif //UTIL_JSON_BIND_HPP
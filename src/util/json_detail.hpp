@@ -0,0 +1,114 @@
+#ifndef UTIL_JSON_DETAIL_HPP
+#define UTIL_JSON_DETAIL_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Formatting and parsing shared by the JSON code in util, so alternative DOMs, serializers and readers
+// emit the same bytes and accept the same input as JSON.
+namespace json
+{
+    class JSON;
+
+    namespace detail
+    {
+        void dump_number(double value, std::string &out);
+
+        void dump_number(int value, std::string &out);
+
+        void dump_number(int64_t value, std::string &out);
+
+        // Value of a number token that already matches the JSON grammar. Integers that fit int64_t stay
+        // exact; everything else is the nearest double.
+        struct number
+        {
+            bool is_integer;
+            int64_t integer;
+            double real;
+        };
+
+        number parse_number(const char *begin, const char *end);
+
+        // value truncated toward zero, or 0, as for a non-number, when it is NaN or out of range; a plain
+        // cast is undefined there, and input like 1e300 comes straight off the wire.
+        int64_t truncate_int64(double value);
+
+        int truncate_int(double value);
+
+        void dump_string(std::string_view value, std::string &out);
+
+        // Exact number of bytes the dump_* functions above append, so output can be sized up front.
+        size_t number_size(double value);
+
+        size_t number_size(int64_t value);
+
+        size_t string_size(std::string_view value);
+
+        // Appends code point pt as UTF-8; negative means nothing pending.
+        void encode_utf8(long pt, std::string &out);
+
+        // How parse errors quote an offending character, e.g. "'x' (120)".
+        std::string esc(char c);
+
+        // Pull reader over one document with JSON::parse's grammar, for code that knows the shape it
+        // expects. Every value() and skip() consumes exactly one value; when the value has a different
+        // type it is skipped and false is returned. Objects and arrays are walked with begin_*() and then
+        // next_*() until it returns false, with `first` starting out true.
+        class reader final
+        {
+        public:
+            explicit reader(const std::string &in) : m_in(in), m_pos(0), m_failed(false)
+            {}
+
+            bool failed() const
+            {
+                return m_failed;
+            }
+
+            const std::string &error() const
+            {
+                return m_err;
+            }
+
+            bool begin_object();
+
+            bool next_member(std::string &name, bool &first);
+
+            bool begin_array();
+
+            bool next_element(bool &first);
+
+            bool value(bool &out);
+
+            bool value(int64_t &out);
+
+            bool value(double &out);
+
+            bool value(std::string &out);
+
+            bool value(JSON &out);
+
+            // The text of the next value, left undecoded. Strings and containers are only checked for
+            // terminated strings and balanced brackets; numbers and literals are checked in full.
+            bool raw(std::string_view &out);
+
+            void skip();
+
+            // Fails unless only whitespace is left.
+            bool finish();
+
+        private:
+            char peek();
+
+            bool fail(std::string &&msg);
+
+            const std::string &m_in;
+            size_t m_pos;
+            bool m_failed;
+            std::string m_err;
+        };
+    }
+}
+
+#endif //UTIL_JSON_DETAIL_HPP
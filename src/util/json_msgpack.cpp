@@ -0,0 +1,633 @@
+#include "json_msgpack.hpp"
+#include "json_detail.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace json
+{
+    namespace msgpack
+    {
+        static const int max_depth = 200;
+
+        static void put_be(uint64_t value, size_t bytes, std::string &out)
+        {
+            for (size_t i = bytes; i-- > 0;)
+                out += static_cast<char>((value >> (i * 8)) & 0xff);
+        }
+
+        static void put_marker(unsigned char marker, std::string &out)
+        {
+            out += static_cast<char>(marker);
+        }
+
+        void pack_integer(int64_t value, std::string &out)
+        {
+            if (value >= 0)
+            {
+                if (value < 0x80)
+                {
+                    put_marker(static_cast<unsigned char>(value), out);
+                }
+                else if (value <= 0xff)
+                {
+                    put_marker(0xcc, out);
+                    put_be(static_cast<uint64_t>(value), 1, out);
+                }
+                else if (value <= 0xffff)
+                {
+                    put_marker(0xcd, out);
+                    put_be(static_cast<uint64_t>(value), 2, out);
+                }
+                else if (value <= 0xffffffffLL)
+                {
+                    put_marker(0xce, out);
+                    put_be(static_cast<uint64_t>(value), 4, out);
+                }
+                else
+                {
+                    put_marker(0xcf, out);
+                    put_be(static_cast<uint64_t>(value), 8, out);
+                }
+            }
+            else if (value >= -32)
+            {
+                put_marker(static_cast<unsigned char>(value), out);
+            }
+            else if (value >= INT8_MIN)
+            {
+                put_marker(0xd0, out);
+                put_be(static_cast<uint64_t>(value), 1, out);
+            }
+            else if (value >= INT16_MIN)
+            {
+                put_marker(0xd1, out);
+                put_be(static_cast<uint64_t>(value), 2, out);
+            }
+            else if (value >= INT32_MIN)
+            {
+                put_marker(0xd2, out);
+                put_be(static_cast<uint64_t>(value), 4, out);
+            }
+            else
+            {
+                put_marker(0xd3, out);
+                put_be(static_cast<uint64_t>(value), 8, out);
+            }
+        }
+
+        static void pack_double(double value, std::string &out)
+        {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            put_marker(0xcb, out);
+            put_be(bits, 8, out);
+        }
+
+        static void pack_string(std::string_view value, std::string &out)
+        {
+            size_t size = value.size();
+            if (size < 32)
+            {
+                put_marker(static_cast<unsigned char>(0xa0 | size), out);
+            }
+            else if (size <= 0xff)
+            {
+                put_marker(0xd9, out);
+                put_be(size, 1, out);
+            }
+            else if (size <= 0xffff)
+            {
+                put_marker(0xda, out);
+                put_be(size, 2, out);
+            }
+            else
+            {
+                put_marker(0xdb, out);
+                put_be(size, 4, out);
+            }
+            out.append(value);
+        }
+
+        // Arrays and maps share a layout: a fix form below 16 entries, then 16 and 32 bit counts.
+        static void pack_container(size_t size, unsigned char fix, unsigned char marker16, std::string &out)
+        {
+            if (size < 16)
+            {
+                put_marker(static_cast<unsigned char>(fix | size), out);
+            }
+            else if (size <= 0xffff)
+            {
+                put_marker(marker16, out);
+                put_be(size, 2, out);
+            }
+            else
+            {
+                put_marker(marker16 + 1, out);
+                put_be(size, 4, out);
+            }
+        }
+
+        void pack_array_header(size_t size, std::string &out)
+        {
+            pack_container(size, 0x90, 0xdc, out);
+        }
+
+        void pack(const JSON &value, std::string &out)
+        {
+            switch (value.type())
+            {
+                case JSON::NUL:
+                    put_marker(0xc0, out);
+                    break;
+                case JSON::BOOL:
+                    put_marker(value.bool_value() ? 0xc3 : 0xc2, out);
+                    break;
+                case JSON::NUMBER:
+                    if (value.is_integer())
+                        pack_integer(value.int64_value(), out);
+                    else
+                        pack_double(value.number_value(), out);
+                    break;
+                case JSON::STRING:
+                    pack_string(value.string_value(), out);
+                    break;
+                case JSON::ARRAY:
+                    pack_container(value.array_items().size(), 0x90, 0xdc, out);
+                    for (const JSON &item : value.array_items())
+                        pack(item, out);
+                    break;
+                case JSON::OBJECT:
+                    pack_container(value.object_items().size(), 0x80, 0xde, out);
+                    for (const auto &member : value.object_items())
+                    {
+                        pack_string(member.first.str(), out);
+                        pack(member.second, out);
+                    }
+                    break;
+            }
+        }
+
+        void pack(const arena_json &value, std::string &out)
+        {
+            switch (value.type())
+            {
+                case JSON::NUL:
+                    put_marker(0xc0, out);
+                    break;
+                case JSON::BOOL:
+                    put_marker(value.bool_value() ? 0xc3 : 0xc2, out);
+                    break;
+                case JSON::NUMBER:
+                    if (value.is_integer())
+                        pack_integer(value.int64_value(), out);
+                    else
+                        pack_double(value.number_value(), out);
+                    break;
+                case JSON::STRING:
+                    pack_string(value.string_value(), out);
+                    break;
+                case JSON::ARRAY:
+                    pack_container(value.size(), 0x90, 0xdc, out);
+                    for (size_t i = 0; i < value.size(); i++)
+                        pack(value.items()[i], out);
+                    break;
+                case JSON::OBJECT:
+                    pack_container(value.size(), 0x80, 0xde, out);
+                    for (size_t i = 0; i < value.size(); i++)
+                    {
+                        pack_string(value.members()[i].key, out);
+                        pack(value.members()[i].value, out);
+                    }
+                    break;
+            }
+        }
+
+        namespace
+        {
+            struct unpacker final
+            {
+                enum kind
+                {
+                    NIL, BOOLEAN, INTEGER, REAL, STRING, ARRAY, MAP
+                };
+
+                struct item
+                {
+                    kind type;
+                    bool boolean;
+                    int64_t integer;
+                    double real;
+                    std::string_view str;
+                    size_t size;
+                };
+
+                const unsigned char *p;
+                const unsigned char *end;
+                std::string &err;
+                bool failed;
+                bool incomplete;
+
+                unpacker(std::string_view in, std::string &err) :
+                        p(reinterpret_cast<const unsigned char *>(in.data())), end(p + in.size()), err(err),
+                        failed(false), incomplete(false)
+                {}
+
+                bool fail(std::string &&msg)
+                {
+                    if (!failed)
+                        err = std::move(msg);
+                    failed = true;
+                    return false;
+                }
+
+                bool need(size_t n)
+                {
+                    if (static_cast<size_t>(end - p) >= n)
+                        return true;
+                    incomplete = true;
+                    return fail("unexpected end of input");
+                }
+
+                uint64_t be(size_t n)
+                {
+                    uint64_t value = 0;
+                    for (size_t i = 0; i < n; i++)
+                        value = (value << 8) | *p++;
+                    return value;
+                }
+
+                // Every element takes at least one byte, so a count is never worth reserving beyond that.
+                size_t reserve_hint(size_t size) const
+                {
+                    return std::min(size, static_cast<size_t>(end - p));
+                }
+
+                bool sized(kind type, size_t bytes, item &it)
+                {
+                    if (!need(bytes))
+                        return false;
+                    it.type = type;
+                    it.size = be(bytes);
+                    return type != STRING || chars(it.size, it);
+                }
+
+                bool chars(size_t size, item &it)
+                {
+                    if (!need(size))
+                        return false;
+                    it.type = STRING;
+                    it.str = std::string_view(reinterpret_cast<const char *>(p), size);
+                    p += size;
+                    return true;
+                }
+
+                bool integer(size_t bytes, bool is_signed, item &it)
+                {
+                    if (!need(bytes))
+                        return false;
+                    uint64_t value = be(bytes);
+                    it.type = INTEGER;
+                    if (!is_signed)
+                    {
+                        if (value > static_cast<uint64_t>(INT64_MAX))
+                        {
+                            it.type = REAL;
+                            it.real = static_cast<double>(value);
+                        }
+                        it.integer = static_cast<int64_t>(value);
+                        return true;
+                    }
+                    // Sign-extend from the top bit of the field.
+                    unsigned shift = static_cast<unsigned>(64 - bytes * 8);
+                    it.integer = static_cast<int64_t>(value << shift) >> shift;
+                    return true;
+                }
+
+                bool next(item &it)
+                {
+                    if (!need(1))
+                        return false;
+
+                    unsigned char marker = *p++;
+                    if (marker < 0x80)
+                    {
+                        it.type = INTEGER;
+                        it.integer = marker;
+                        return true;
+                    }
+                    if (marker < 0x90)
+                    {
+                        it.type = MAP;
+                        it.size = marker & 0x0f;
+                        return true;
+                    }
+                    if (marker < 0xa0)
+                    {
+                        it.type = ARRAY;
+                        it.size = marker & 0x0f;
+                        return true;
+                    }
+                    if (marker < 0xc0)
+                        return chars(marker & 0x1f, it);
+                    if (marker >= 0xe0)
+                    {
+                        it.type = INTEGER;
+                        it.integer = static_cast<int8_t>(marker);
+                        return true;
+                    }
+
+                    switch (marker)
+                    {
+                        case 0xc0:
+                            it.type = NIL;
+                            return true;
+                        case 0xc2:
+                        case 0xc3:
+                            it.type = BOOLEAN;
+                            it.boolean = marker == 0xc3;
+                            return true;
+                        case 0xca:
+                        {
+                            if (!need(4))
+                                return false;
+                            uint32_t bits = static_cast<uint32_t>(be(4));
+                            float value;
+                            memcpy(&value, &bits, sizeof(value));
+                            it.type = REAL;
+                            it.real = value;
+                            return true;
+                        }
+                        case 0xcb:
+                        {
+                            if (!need(8))
+                                return false;
+                            uint64_t bits = be(8);
+                            it.type = REAL;
+                            memcpy(&it.real, &bits, sizeof(it.real));
+                            return true;
+                        }
+                        case 0xcc:
+                            return integer(1, false, it);
+                        case 0xcd:
+                            return integer(2, false, it);
+                        case 0xce:
+                            return integer(4, false, it);
+                        case 0xcf:
+                            return integer(8, false, it);
+                        case 0xd0:
+                            return integer(1, true, it);
+                        case 0xd1:
+                            return integer(2, true, it);
+                        case 0xd2:
+                            return integer(4, true, it);
+                        case 0xd3:
+                            return integer(8, true, it);
+                        case 0xd9:
+                            return sized(STRING, 1, it);
+                        case 0xda:
+                            return sized(STRING, 2, it);
+                        case 0xdb:
+                            return sized(STRING, 4, it);
+                        case 0xdc:
+                            return sized(ARRAY, 2, it);
+                        case 0xdd:
+                            return sized(ARRAY, 4, it);
+                        case 0xde:
+                            return sized(MAP, 2, it);
+                        case 0xdf:
+                            return sized(MAP, 4, it);
+                        default:
+                        {
+                            char buf[40];
+                            snprintf(buf, sizeof buf, "unsupported MessagePack type 0x%02x", marker);
+                            return fail(buf);
+                        }
+                    }
+                }
+
+                bool enter(int depth)
+                {
+                    return depth <= max_depth || fail("exceeded maximum nesting depth");
+                }
+
+                bool key(item &it)
+                {
+                    if (!next(it))
+                        return false;
+                    return it.type == STRING || fail("map key is not a string");
+                }
+
+                JSON to_json(int depth)
+                {
+                    item it;
+                    if (!next(it))
+                        return JSON();
+
+                    switch (it.type)
+                    {
+                        case NIL:
+                            return JSON();
+                        case BOOLEAN:
+                            return it.boolean;
+                        case INTEGER:
+                            return it.integer;
+                        case REAL:
+                            return it.real;
+                        case STRING:
+                            return std::string(it.str);
+                        case ARRAY:
+                        {
+                            if (!enter(depth))
+                                return JSON();
+                            JSON::array values;
+                            values.reserve(reserve_hint(it.size));
+                            for (size_t i = 0; i < it.size; i++)
+                            {
+                                values.push_back(to_json(depth + 1));
+                                if (failed)
+                                    return JSON();
+                            }
+                            return values;
+                        }
+                        case MAP:
+                        {
+                            if (!enter(depth))
+                                return JSON();
+                            std::vector<JSON::object::value_type> members;
+                            members.reserve(reserve_hint(it.size));
+                            for (size_t i = 0; i < it.size; i++)
+                            {
+                                item name;
+                                if (!key(name))
+                                    return JSON();
+                                JSON value = to_json(depth + 1);
+                                if (failed)
+                                    return JSON();
+                                members.emplace_back(json::key(name.str), std::move(value));
+                            }
+                            return JSON::object::adopt(std::move(members));
+                        }
+                    }
+                    return JSON();
+                }
+
+                bool to_text(std::string &out, int depth)
+                {
+                    item it;
+                    if (!next(it))
+                        return false;
+
+                    switch (it.type)
+                    {
+                        case NIL:
+                            out += "null";
+                            return true;
+                        case BOOLEAN:
+                            out += it.boolean ? "true" : "false";
+                            return true;
+                        case INTEGER:
+                            detail::dump_number(it.integer, out);
+                            return true;
+                        case REAL:
+                            detail::dump_number(it.real, out);
+                            return true;
+                        case STRING:
+                            detail::dump_string(it.str, out);
+                            return true;
+                        case ARRAY:
+                            if (!enter(depth))
+                                return false;
+                            out += '[';
+                            for (size_t i = 0; i < it.size; i++)
+                            {
+                                if (i)
+                                    out += ", ";
+                                if (!to_text(out, depth + 1))
+                                    return false;
+                            }
+                            out += ']';
+                            return true;
+                        case MAP:
+                            if (!enter(depth))
+                                return false;
+                            out += '{';
+                            for (size_t i = 0; i < it.size; i++)
+                            {
+                                item name;
+                                if (!key(name))
+                                    return false;
+                                if (i)
+                                    out += ", ";
+                                detail::dump_string(name.str, out);
+                                out += ": ";
+                                if (!to_text(out, depth + 1))
+                                    return false;
+                            }
+                            out += '}';
+                            return true;
+                    }
+                    return false;
+                }
+
+                bool skip(int depth)
+                {
+                    item it;
+                    if (!next(it))
+                        return false;
+                    if (it.type != ARRAY && it.type != MAP)
+                        return true;
+                    if (!enter(depth))
+                        return false;
+
+                    size_t count = it.type == MAP ? it.size * 2 : it.size;
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        if (!skip(depth + 1))
+                            return false;
+                    }
+                    return true;
+                }
+
+                bool finish()
+                {
+                    return p == end || fail("unexpected trailing bytes");
+                }
+            };
+        }
+
+        JSON unpack(std::string_view in, std::string &err)
+        {
+            unpacker parser(in, err);
+            JSON result = parser.to_json(0);
+            if (parser.failed || !parser.finish())
+                return JSON();
+            return result;
+        }
+
+        bool to_text(std::string_view in, std::string &out, std::string &err)
+        {
+            // Text is longer than its packed form: quotes, separators and spelled-out numbers.
+            out.reserve(out.size() + in.size() * 2);
+            unpacker parser(in, err);
+            return parser.to_text(out, 0) && parser.finish();
+        }
+
+        size_t frame_size(std::string_view in, std::string &err)
+        {
+            unpacker parser(in, err);
+            if (parser.skip(0))
+                return static_cast<size_t>(parser.p - reinterpret_cast<const unsigned char *>(in.data()));
+            if (parser.incomplete)
+                err.clear();
+            return 0;
+        }
+
+        size_t frame_size(std::string_view in, frame_scanner &scan, std::string &err)
+        {
+            if (scan.pending.empty())
+                scan.pending.push_back(1);
+
+            const unsigned char *base = reinterpret_cast<const unsigned char *>(in.data());
+            unpacker parser(in.substr(scan.offset), err);
+            while (!scan.pending.empty())
+            {
+                if (scan.pending.back() == 0)
+                {
+                    scan.pending.pop_back();
+                    continue;
+                }
+
+                // An element is taken whole or not at all, so a later call starts again at its marker.
+                const unsigned char *at = parser.p;
+                unpacker::item it;
+                if (!parser.next(it))
+                {
+                    if (!parser.incomplete)
+                    {
+                        scan.reset();
+                        return 0;
+                    }
+                    err.clear();
+                    scan.offset = static_cast<size_t>(at - base);
+                    return 0;
+                }
+                scan.pending.back()--;
+                if (it.type == unpacker::ARRAY || it.type == unpacker::MAP)
+                {
+                    if (!parser.enter(static_cast<int>(scan.pending.size()) - 1))
+                    {
+                        scan.reset();
+                        return 0;
+                    }
+                    scan.pending.push_back(it.type == unpacker::MAP ? it.size * 2 : it.size);
+                }
+            }
+            scan.reset();
+            return static_cast<size_t>(parser.p - base);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef UTIL_JSON_MSGPACK_HPP
+#define UTIL_JSON_MSGPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/JSON.hpp>
+#include <util/json_arena.hpp>
+
+// MessagePack encoding of JSON values. Integers take the smallest format that holds them, other numbers
+// are float64, and object members go out in the DOM's order, so equal values pack to equal bytes. Map
+// keys must be strings; bin and ext values are rejected.
+namespace json
+{
+    namespace msgpack
+    {
+        void pack(const JSON &value, std::string &out);
+
+        void pack(const arena_json &value, std::string &out);
+
+        inline std::string pack(const JSON &value)
+        {
+            std::string out;
+            pack(value, out);
+            return out;
+        }
+
+        // A single integer in its smallest format, as pack() writes integers.
+        void pack_integer(int64_t value, std::string &out);
+
+        // The header of an array of size elements; the packed elements follow it.
+        void pack_array_header(size_t size, std::string &out);
+
+        JSON unpack(std::string_view in, std::string &err);
+
+        // Rewrites one packed value as JSON text, without building a DOM. Members keep their packed order.
+        bool to_text(std::string_view in, std::string &out, std::string &err);
+
+        // Length of the packed value at the start of in, or 0 while more bytes are needed. Malformed
+        // input also returns 0 and sets err.
+        size_t frame_size(std::string_view in, std::string &err);
+
+        // How far frame_size has got through a value that arrives in pieces: the offset of the first
+        // element not yet seen whole, and the elements still owed at each open level.
+        struct frame_scanner
+        {
+            size_t offset = 0;
+            std::vector<size_t> pending;
+
+            void reset()
+            {
+                offset = 0;
+                pending.clear();
+            }
+        };
+
+        // frame_size for a value whose bytes so far are in, where in only grows between calls. Each call
+        // carries on where scan stopped, so a large frame is scanned once rather than once per read. scan
+        // is reset when the value is complete or malformed.
+        size_t frame_size(std::string_view in, frame_scanner &scan, std::string &err);
+
+        // A frame starting with a map or array marker is packed; JSON text never starts with one of these
+        // bytes. Arrays carry batches of payloads.
+        inline bool is_frame_start(char ch)
+        {
+            unsigned char byte = static_cast<unsigned char>(ch);
+            return (byte & 0xe0) == 0x80 || (byte >= 0xdc && byte <= 0xdf);
+        }
+    }
+}
+
+#endif //UTIL_JSON_MSGPACK_HPP
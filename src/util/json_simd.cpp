@@ -0,0 +1,325 @@
+#include "json_simd.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace json
+{
+    namespace simd
+    {
+        struct block_masks
+        {
+            uint64_t quote;
+            uint64_t backslash;
+            uint64_t op;
+            uint64_t whitespace;
+        };
+
+        typedef void (*classify_fn)(const uint8_t *block, block_masks &masks);
+
+        typedef size_t (*find_fn)(const char *data, size_t size);
+
+        static void classify_scalar(const uint8_t *block, block_masks &masks)
+        {
+            masks = block_masks{0, 0, 0, 0};
+            for (int i = 0; i < 64; i++)
+            {
+                uint64_t bit = uint64_t(1) << i;
+                switch (block[i])
+                {
+                    case '"':
+                        masks.quote |= bit;
+                        break;
+                    case '\\':
+                        masks.backslash |= bit;
+                        break;
+                    case '{':
+                    case '}':
+                    case '[':
+                    case ']':
+                    case ':':
+                    case ',':
+                        masks.op |= bit;
+                        break;
+                    case ' ':
+                    case '\t':
+                    case '\n':
+                    case '\r':
+                        masks.whitespace |= bit;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        static inline bool is_string_special(uint8_t ch)
+        {
+            return ch == '"' || ch == '\\' || ch < 0x20;
+        }
+
+        static size_t find_escape_scalar(const char *data, const size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                uint8_t ch = static_cast<uint8_t>(data[i]);
+                if (is_string_special(ch) || ch == 0xe2)
+                    return i;
+            }
+            return size;
+        }
+
+        static size_t find_string_special_scalar(const char *data, const size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                if (is_string_special(static_cast<uint8_t>(data[i])))
+                    return i;
+            }
+            return size;
+        }
+
+#ifdef JSON_SIMD_X86
+        // '[' and ']' differ from '{' and '}' only in bit 0x20, so four compares cover all six operators.
+
+        __attribute__((target("avx2")))
+        static inline uint32_t eq_avx2(__m256i v, char c)
+        {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+        }
+
+        __attribute__((target("avx2")))
+        static void classify_avx2(const uint8_t *block, block_masks &masks)
+        {
+            masks = block_masks{0, 0, 0, 0};
+            for (int half = 0; half < 2; half++)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * half));
+                __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+                int shift = 32 * half;
+                masks.quote |= uint64_t(eq_avx2(v, '"')) << shift;
+                masks.backslash |= uint64_t(eq_avx2(v, '\\')) << shift;
+                masks.op |= uint64_t(eq_avx2(folded, '{') | eq_avx2(folded, '}')
+                                     | eq_avx2(v, ':') | eq_avx2(v, ',')) << shift;
+                masks.whitespace |= uint64_t(eq_avx2(v, ' ') | eq_avx2(v, '\t')
+                                             | eq_avx2(v, '\n') | eq_avx2(v, '\r')) << shift;
+            }
+        }
+
+        // Unsigned v <= 0x1f is the same as a saturating v - 0x1f being zero.
+        __attribute__((target("avx2")))
+        static inline uint32_t special_avx2(__m256i v, bool with_e2)
+        {
+            __m256i special = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+                    _mm256_cmpeq_epi8(_mm256_subs_epu8(v, _mm256_set1_epi8(0x1f)), _mm256_setzero_si256()));
+            if (with_e2)
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(0xe2))));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        }
+
+        template<bool with_e2>
+        __attribute__((target("avx2")))
+        static size_t find_avx2(const char *data, const size_t size)
+        {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32)
+            {
+                uint32_t mask = special_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), with_e2);
+                if (mask)
+                    return i + __builtin_ctz(mask);
+            }
+            return i + (with_e2 ? find_escape_scalar(data + i, size - i) : find_string_special_scalar(data + i, size - i));
+        }
+
+        __attribute__((target("sse4.2")))
+        static inline uint32_t special_sse42(__m128i v, bool with_e2)
+        {
+            __m128i special = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                    _mm_cmpeq_epi8(_mm_subs_epu8(v, _mm_set1_epi8(0x1f)), _mm_setzero_si128()));
+            if (with_e2)
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(0xe2))));
+            return static_cast<uint32_t>(_mm_movemask_epi8(special));
+        }
+
+        template<bool with_e2>
+        __attribute__((target("sse4.2")))
+        static size_t find_sse42(const char *data, const size_t size)
+        {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16)
+            {
+                uint32_t mask = special_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), with_e2);
+                if (mask)
+                    return i + __builtin_ctz(mask);
+            }
+            return i + (with_e2 ? find_escape_scalar(data + i, size - i) : find_string_special_scalar(data + i, size - i));
+        }
+
+        __attribute__((target("sse4.2")))
+        static inline uint32_t eq_sse42(__m128i v, char c)
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+        }
+
+        __attribute__((target("sse4.2")))
+        static void classify_sse42(const uint8_t *block, block_masks &masks)
+        {
+            masks = block_masks{0, 0, 0, 0};
+            for (int quarter = 0; quarter < 4; quarter++)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * quarter));
+                __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+                int shift = 16 * quarter;
+                masks.quote |= uint64_t(eq_sse42(v, '"')) << shift;
+                masks.backslash |= uint64_t(eq_sse42(v, '\\')) << shift;
+                masks.op |= uint64_t(eq_sse42(folded, '{') | eq_sse42(folded, '}')
+                                     | eq_sse42(v, ':') | eq_sse42(v, ',')) << shift;
+                masks.whitespace |= uint64_t(eq_sse42(v, ' ') | eq_sse42(v, '\t')
+                                             | eq_sse42(v, '\n') | eq_sse42(v, '\r')) << shift;
+            }
+        }
+#endif
+
+        struct dispatch
+        {
+            classify_fn classify;
+            find_fn find_escape;
+            find_fn find_string_special;
+            const char *name;
+
+            dispatch() : classify(classify_scalar), find_escape(find_escape_scalar),
+                         find_string_special(find_string_special_scalar), name("scalar")
+            {
+#ifdef JSON_SIMD_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2"))
+                {
+                    classify = classify_avx2;
+                    find_escape = find_avx2<true>;
+                    find_string_special = find_avx2<false>;
+                    name = "avx2";
+                }
+                else if (__builtin_cpu_supports("sse4.2"))
+                {
+                    classify = classify_sse42;
+                    find_escape = find_sse42<true>;
+                    find_string_special = find_sse42<false>;
+                    name = "sse4.2";
+                }
+#endif
+            }
+        };
+
+        static const dispatch &get_dispatch()
+        {
+            static const dispatch d;
+            return d;
+        }
+
+        const char *backend()
+        {
+            return get_dispatch().name;
+        }
+
+        // Most keys and short values are a handful of bytes; they are not worth the indirect call.
+
+        size_t find_escape(const char *data, const size_t size)
+        {
+            if (size < 16)
+                return find_escape_scalar(data, size);
+            return get_dispatch().find_escape(data, size);
+        }
+
+        size_t find_string_special(const char *data, const size_t size)
+        {
+            if (size < 16)
+                return find_string_special_scalar(data, size);
+            return get_dispatch().find_string_special(data, size);
+        }
+
+        static inline uint64_t prefix_xor(uint64_t x)
+        {
+            x ^= x << 1;
+            x ^= x << 2;
+            x ^= x << 4;
+            x ^= x << 8;
+            x ^= x << 16;
+            x ^= x << 32;
+            return x;
+        }
+
+        // Escapes are rare, so walking the backslashes one by one is cheaper than the branchless carry tricks.
+        static inline uint64_t find_escaped(uint64_t backslash, uint64_t &carry)
+        {
+            uint64_t escaped = carry;
+            carry = 0;
+            backslash &= ~escaped;
+            while (backslash)
+            {
+                int i = __builtin_ctzll(backslash);
+                backslash &= backslash - 1;
+                if (i == 63)
+                {
+                    carry = 1;
+                }
+                else
+                {
+                    escaped |= uint64_t(1) << (i + 1);
+                    backslash &= ~(uint64_t(1) << (i + 1));
+                }
+            }
+            return escaped;
+        }
+
+        void structural_index(const char *data, const size_t size, std::vector<uint32_t> &out)
+        {
+            classify_fn classify = get_dispatch().classify;
+
+            // Every byte can be structural at worst; size once and trim at the end instead of growing.
+            out.resize(size + 1);
+            uint32_t *tail = out.data();
+
+            uint64_t escape_carry = 0;
+            uint64_t in_string_carry = 0;
+            uint64_t separator_carry = 1;
+
+            uint8_t padded[64];
+            for (size_t base = 0; base < size; base += 64)
+            {
+                const uint8_t *block = reinterpret_cast<const uint8_t *>(data + base);
+                if (size - base < 64)
+                {
+                    memset(padded, ' ', sizeof(padded));
+                    memcpy(padded, block, size - base);
+                    block = padded;
+                }
+
+                block_masks masks;
+                classify(block, masks);
+
+                uint64_t quotes = masks.quote & ~find_escaped(masks.backslash, escape_carry);
+                uint64_t in_string = prefix_xor(quotes) ^ in_string_carry;
+                in_string_carry = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+                uint64_t separators = masks.op | masks.whitespace | quotes;
+                uint64_t scalar_starts = ~separators & ~in_string & ((separators << 1) | separator_carry);
+                separator_carry = separators >> 63;
+
+                uint64_t structurals = (masks.op & ~in_string) | quotes | scalar_starts;
+                while (structurals)
+                {
+                    *tail++ = static_cast<uint32_t>(base + __builtin_ctzll(structurals));
+                    structurals &= structurals - 1;
+                }
+            }
+            out.resize(static_cast<size_t>(tail - out.data()));
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef UTIL_JSON_SIMD_HPP
+#define UTIL_JSON_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace json
+{
+    namespace simd
+    {
+        // Fills out with the offsets of every structural character ({}[]:,) outside strings, every unescaped
+        // quote and the first byte of every scalar token, in input order. The input must be smaller than 4 GiB.
+        void structural_index(const char *data, size_t size, std::vector<uint32_t> &out);
+
+        // Offset of the first byte dump() cannot copy verbatim: '"', '\\', a control character or 0xE2, the
+        // lead byte of U+2028/U+2029. Returns size when the whole range is clean.
+        size_t find_escape(const char *data, size_t size);
+
+        // Offset of the first '"', '\\' or control character, i.e. where a string body stops being a
+        // plain copy. Returns size when the whole range is clean.
+        size_t find_string_special(const char *data, size_t size);
+
+        // Name of the instruction set picked at startup: "avx2", "sse4.2" or "scalar".
+        const char *backend();
+    }
+}
+
+#endif //UTIL_JSON_SIMD_HPP
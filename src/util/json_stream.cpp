@@ -0,0 +1,502 @@
+#include "json_stream.hpp"
+#include "json_detail.hpp"
+#include "json_simd.hpp"
+
+#include <cstdlib>
+
+namespace json
+{
+    static const size_t max_depth = 200;
+
+    using detail::esc;
+
+    static inline bool is_whitespace(char ch)
+    {
+        return ch == ' ' || ch == '\r' || ch == '\n' || ch == '\t';
+    }
+
+    static inline bool is_digit(char ch)
+    {
+        return ch >= '0' && ch <= '9';
+    }
+
+    static inline bool is_hex(char ch)
+    {
+        return is_digit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+    }
+
+    stream_parser::stream_parser(sax_handler &handler, json_parse strategy) :
+            m_handler(handler), m_strategy(strategy), m_state(VALUE), m_resume(VALUE), m_number(N_INT),
+            m_started(false), m_key(false), m_literal(nullptr), m_literal_pos(0), m_last_escaped_codepoint(-1)
+    {
+    }
+
+    void stream_parser::reset()
+    {
+        m_state = VALUE;
+        m_resume = VALUE;
+        m_started = false;
+        m_last_escaped_codepoint = -1;
+        m_token.clear();
+        m_stack.clear();
+        m_err.clear();
+    }
+
+    void stream_parser::fail(std::string &&msg)
+    {
+        if (m_state != FAILED)
+            m_err = std::move(msg);
+        m_state = FAILED;
+    }
+
+    size_t stream_parser::feed(const char *data, const size_t size)
+    {
+        size_t i = 0;
+        while (i < size && m_state != DONE && m_state != FAILED)
+        {
+            char ch = data[i];
+            switch (m_state)
+            {
+                case STRING:
+                {
+                    size_t run = simd::find_string_special(data + i, size - i);
+                    if (run > 0)
+                    {
+                        flush_codepoint();
+                        m_token.append(data + i, run);
+                        i += run;
+                    }
+                    else
+                    {
+                        string_char(ch);
+                        i++;
+                    }
+                    continue;
+                }
+                case STRING_ESCAPE:
+                    string_escape(ch);
+                    i++;
+                    continue;
+                case STRING_UNICODE:
+                    string_unicode(ch);
+                    i++;
+                    continue;
+                case NUMBER:
+                    // A number only ends at the first byte that is not part of it, which is then read again.
+                    if (number_char(ch))
+                        i++;
+                    continue;
+                case LITERAL:
+                    literal_char(ch);
+                    i++;
+                    continue;
+                case COMMENT_START:
+                    if (ch == '/')
+                        m_state = LINE_COMMENT;
+                    else if (ch == '*')
+                        m_state = BLOCK_COMMENT;
+                    else
+                        fail("malformed comment");
+                    i++;
+                    continue;
+                case LINE_COMMENT:
+                    if (ch == '\n')
+                        m_state = m_resume;
+                    i++;
+                    continue;
+                case BLOCK_COMMENT:
+                    if (ch == '*')
+                        m_state = BLOCK_COMMENT_STAR;
+                    i++;
+                    continue;
+                case BLOCK_COMMENT_STAR:
+                    if (ch == '/')
+                        m_state = m_resume;
+                    else if (ch != '*')
+                        m_state = BLOCK_COMMENT;
+                    i++;
+                    continue;
+                default:
+                    break;
+            }
+
+            i++;
+            if (skip_garbage(ch))
+                continue;
+            m_started = true;
+
+            switch (m_state)
+            {
+                case VALUE:
+                    begin_value(ch);
+                    break;
+                case ARRAY_FIRST:
+                    if (ch == ']')
+                    {
+                        m_stack.pop_back();
+                        m_handler.end_array();
+                        end_value();
+                    }
+                    else
+                    {
+                        begin_value(ch);
+                    }
+                    break;
+                case OBJECT_FIRST:
+                    if (ch == '}')
+                    {
+                        m_stack.pop_back();
+                        m_handler.end_object();
+                        end_value();
+                        break;
+                    }
+                    // fall through
+                case OBJECT_KEY:
+                    if (ch != '"')
+                    {
+                        fail("expected '\"' in object, got " + esc(ch));
+                        break;
+                    }
+                    m_key = true;
+                    m_token.clear();
+                    m_state = STRING;
+                    break;
+                case COLON:
+                    if (ch != ':')
+                        fail("expected ':' in object, got " + esc(ch));
+                    else
+                        m_state = VALUE;
+                    break;
+                case AFTER_VALUE:
+                    if (m_stack.back() == '{')
+                    {
+                        if (ch == '}')
+                        {
+                            m_stack.pop_back();
+                            m_handler.end_object();
+                            end_value();
+                        }
+                        else if (ch == ',')
+                        {
+                            m_state = OBJECT_KEY;
+                        }
+                        else
+                        {
+                            fail("expected ',' in object, got " + esc(ch));
+                        }
+                    }
+                    else
+                    {
+                        if (ch == ']')
+                        {
+                            m_stack.pop_back();
+                            m_handler.end_array();
+                            end_value();
+                        }
+                        else if (ch == ',')
+                        {
+                            m_state = VALUE;
+                        }
+                        else
+                        {
+                            fail("expected ',' in list, got " + esc(ch));
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return i;
+    }
+
+    void stream_parser::finish()
+    {
+        if (m_state == LINE_COMMENT)
+            m_state = m_resume;
+
+        switch (m_state)
+        {
+            case DONE:
+            case FAILED:
+                return;
+            case NUMBER:
+                if (m_stack.empty())
+                {
+                    number_char(' ');
+                    return;
+                }
+                break;
+            case STRING:
+            case STRING_ESCAPE:
+            case STRING_UNICODE:
+                fail("unexpected end of input in string");
+                return;
+            case COMMENT_START:
+                fail("unexpected end of input after start of comment");
+                return;
+            case BLOCK_COMMENT:
+            case BLOCK_COMMENT_STAR:
+                fail("unexpected end of input inside multi-line comment");
+                return;
+            default:
+                break;
+        }
+        fail("unexpected end of input");
+    }
+
+    bool stream_parser::skip_garbage(char ch)
+    {
+        if (is_whitespace(ch))
+            return true;
+        if (ch == '/' && m_strategy == json_parse::COMMENTS)
+        {
+            m_resume = m_state;
+            m_state = COMMENT_START;
+            return true;
+        }
+        return false;
+    }
+
+    void stream_parser::begin_value(char ch)
+    {
+        if (m_stack.size() > max_depth)
+        {
+            fail("exceeded maximum nesting depth");
+            return;
+        }
+
+        if (ch == '"')
+        {
+            m_key = false;
+            m_token.clear();
+            m_state = STRING;
+        }
+        else if (ch == '-' || is_digit(ch))
+        {
+            m_token.assign(1, ch);
+            m_number = ch == '-' ? N_SIGN : ch == '0' ? N_ZERO : N_INT;
+            m_state = NUMBER;
+        }
+        else if (ch == 't' || ch == 'f' || ch == 'n')
+        {
+            m_literal = ch == 't' ? "true" : ch == 'f' ? "false" : "null";
+            m_literal_pos = 1;
+            m_state = LITERAL;
+        }
+        else if (ch == '{')
+        {
+            m_stack.push_back('{');
+            m_handler.start_object();
+            m_state = OBJECT_FIRST;
+        }
+        else if (ch == '[')
+        {
+            m_stack.push_back('[');
+            m_handler.start_array();
+            m_state = ARRAY_FIRST;
+        }
+        else
+        {
+            fail("expected value, got " + esc(ch));
+        }
+    }
+
+    void stream_parser::end_value()
+    {
+        m_state = m_stack.empty() ? DONE : AFTER_VALUE;
+    }
+
+    void stream_parser::flush_codepoint()
+    {
+        detail::encode_utf8(m_last_escaped_codepoint, m_token);
+        m_last_escaped_codepoint = -1;
+    }
+
+    void stream_parser::string_char(char ch)
+    {
+        if (ch == '"')
+        {
+            flush_codepoint();
+            if (m_key)
+            {
+                m_handler.key(m_token);
+                m_state = COLON;
+            }
+            else
+            {
+                m_handler.string_value(m_token);
+                end_value();
+            }
+        }
+        else if (ch == '\\')
+        {
+            m_state = STRING_ESCAPE;
+        }
+        else
+        {
+            fail("unescaped " + esc(ch) + " in string");
+        }
+    }
+
+    void stream_parser::string_escape(char ch)
+    {
+        if (ch == 'u')
+        {
+            m_hex.clear();
+            m_state = STRING_UNICODE;
+            return;
+        }
+
+        flush_codepoint();
+        m_state = STRING;
+        switch (ch)
+        {
+            case 'b':
+                m_token += '\b';
+                break;
+            case 'f':
+                m_token += '\f';
+                break;
+            case 'n':
+                m_token += '\n';
+                break;
+            case 'r':
+                m_token += '\r';
+                break;
+            case 't':
+                m_token += '\t';
+                break;
+            case '"':
+            case '\\':
+            case '/':
+                m_token += ch;
+                break;
+            default:
+                fail("invalid escape character " + esc(ch));
+                break;
+        }
+    }
+
+    void stream_parser::string_unicode(char ch)
+    {
+        m_hex += ch;
+        if (!is_hex(ch))
+        {
+            fail("bad \\u escape: " + m_hex);
+            return;
+        }
+        if (m_hex.size() < 4)
+            return;
+
+        // Same surrogate handling as JSON::parse: a pair becomes one code point, anything else is kept.
+        long codepoint = strtol(m_hex.c_str(), nullptr, 16);
+        if (m_last_escaped_codepoint >= 0xD800 && m_last_escaped_codepoint <= 0xDBFF
+            && codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+        {
+            detail::encode_utf8((((m_last_escaped_codepoint - 0xD800) << 10) | (codepoint - 0xDC00)) + 0x10000,
+                                m_token);
+            m_last_escaped_codepoint = -1;
+        }
+        else
+        {
+            flush_codepoint();
+            m_last_escaped_codepoint = codepoint;
+        }
+        m_state = STRING;
+    }
+
+    bool stream_parser::number_char(char ch)
+    {
+        bool digit = is_digit(ch);
+        switch (m_number)
+        {
+            case N_SIGN:
+                if (!digit)
+                {
+                    fail("invalid " + esc(ch) + " in number");
+                    return true;
+                }
+                m_number = ch == '0' ? N_ZERO : N_INT;
+                break;
+            case N_ZERO:
+                if (digit)
+                {
+                    fail("leading 0s not permitted in numbers");
+                    return true;
+                }
+                // fall through
+            case N_INT:
+                if (digit)
+                    break;
+                if (ch == '.')
+                    m_number = N_FRAC_START;
+                else if (ch == 'e' || ch == 'E')
+                    m_number = N_EXP_START;
+                else
+                    goto end;
+                break;
+            case N_FRAC_START:
+                if (!digit)
+                {
+                    fail("at least one digit required in fractional part");
+                    return true;
+                }
+                m_number = N_FRAC;
+                break;
+            case N_FRAC:
+                if (digit)
+                    break;
+                if (ch == 'e' || ch == 'E')
+                    m_number = N_EXP_START;
+                else
+                    goto end;
+                break;
+            case N_EXP_START:
+                if (ch == '+' || ch == '-')
+                {
+                    m_number = N_EXP_SIGN;
+                    break;
+                }
+                // fall through
+            case N_EXP_SIGN:
+                if (!digit)
+                {
+                    fail("at least one digit required in exponent");
+                    return true;
+                }
+                m_number = N_EXP;
+                break;
+            case N_EXP:
+                if (!digit)
+                    goto end;
+                break;
+        }
+        m_token += ch;
+        return true;
+
+        end:
+        m_handler.number_value(m_token);
+        end_value();
+        return false;
+    }
+
+    void stream_parser::literal_char(char ch)
+    {
+        if (ch != m_literal[m_literal_pos])
+        {
+            fail("parse error: expected " + std::string(m_literal) + ", got "
+                 + std::string(m_literal, m_literal_pos) + ch);
+            return;
+        }
+
+        if (m_literal[++m_literal_pos] != '\0')
+            return;
+
+        if (m_literal[0] == 'n')
+            m_handler.null_value();
+        else
+            m_handler.bool_value(m_literal[0] == 't');
+        end_value();
+    }
+}
@@ -0,0 +1,145 @@
+#ifndef UTIL_JSON_STREAM_HPP
+#define UTIL_JSON_STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/JSON.hpp>
+
+namespace json
+{
+    // Events of one document, in input order. Strings and keys arrive decoded; numbers arrive as their
+    // text so the handler chooses the representation. The views are only valid during the call.
+    class sax_handler
+    {
+    public:
+        virtual ~sax_handler()
+        {}
+
+        virtual void null_value()
+        {}
+
+        virtual void bool_value(bool /*value*/)
+        {}
+
+        virtual void number_value(std::string_view /*text*/)
+        {}
+
+        virtual void string_value(std::string_view /*value*/)
+        {}
+
+        virtual void key(std::string_view /*key*/)
+        {}
+
+        virtual void start_object()
+        {}
+
+        virtual void end_object()
+        {}
+
+        virtual void start_array()
+        {}
+
+        virtual void end_array()
+        {}
+    };
+
+    // Push parser that keeps its state between chunks, so a document may be split at any byte. Only the
+    // string or number being read is buffered. feed() stops right after one complete top-level value and
+    // returns how many bytes it used; reset() starts the next document. The two halves of a ring buffer
+    // are fed one after the other. Grammar and error messages follow JSON::parse, except that an error
+    // quotes only the bytes seen so far.
+    class stream_parser final
+    {
+    public:
+        explicit stream_parser(sax_handler &handler, json_parse strategy = json_parse::STANDARD);
+
+        size_t feed(const char *data, size_t size);
+
+        size_t feed(std::string_view chunk)
+        {
+            return feed(chunk.data(), chunk.size());
+        }
+
+        // End of input: completes a top-level number that was waiting for a delimiter, or fails if a
+        // value is still open.
+        void finish();
+
+        bool done() const
+        {
+            return m_state == DONE;
+        }
+
+        bool failed() const
+        {
+            return m_state == FAILED;
+        }
+
+        // True once the current document has seen anything besides whitespace.
+        bool started() const
+        {
+            return m_started;
+        }
+
+        const std::string &error() const
+        {
+            return m_err;
+        }
+
+        void reset();
+
+    private:
+        enum state : uint8_t
+        {
+            VALUE, ARRAY_FIRST, OBJECT_FIRST, OBJECT_KEY, COLON, AFTER_VALUE,
+            STRING, STRING_ESCAPE, STRING_UNICODE, NUMBER, LITERAL,
+            COMMENT_START, LINE_COMMENT, BLOCK_COMMENT, BLOCK_COMMENT_STAR,
+            DONE, FAILED
+        };
+
+        enum number_state : uint8_t
+        {
+            N_SIGN, N_ZERO, N_INT, N_FRAC_START, N_FRAC, N_EXP_START, N_EXP_SIGN, N_EXP
+        };
+
+        void fail(std::string &&msg);
+
+        bool skip_garbage(char ch);
+
+        void begin_value(char ch);
+
+        void end_value();
+
+        void string_char(char ch);
+
+        void string_escape(char ch);
+
+        void string_unicode(char ch);
+
+        void flush_codepoint();
+
+        bool number_char(char ch);
+
+        void literal_char(char ch);
+
+        sax_handler &m_handler;
+        json_parse m_strategy;
+        state m_state;
+        state m_resume;
+        number_state m_number;
+        bool m_started;
+        bool m_key;
+        const char *m_literal;
+        size_t m_literal_pos;
+        long m_last_escaped_codepoint;
+        std::string m_hex;
+        std::string m_token;
+        std::vector<char> m_stack;
+        std::string m_err;
+    };
+}
+
+#endif //UTIL_JSON_STREAM_HPP
@@ -0,0 +1,61 @@
+#include "json_template.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <util/json_detail.hpp>
+#include <util/json_msgpack.hpp>
+
+namespace json
+{
+    JSON message_template::slot(std::string_view name)
+    {
+        // A control character keeps the placeholder from matching ordinary text in the shape.
+        return JSON("\x01" + std::string(name));
+    }
+
+    message_template::message_template(const JSON &shape, std::initializer_list<std::string_view> names,
+                                       encoding format) : m_format(format)
+    {
+        if (m_format == MSGPACK)
+            msgpack::pack(shape, m_bytes);
+        else
+            shape.dump(m_bytes);
+
+        size_t index = 0;
+        for (std::string_view name : names)
+        {
+            std::string placeholder;
+            if (m_format == MSGPACK)
+                msgpack::pack(slot(name), placeholder);
+            else
+                slot(name).dump(placeholder);
+
+            size_t offset = m_bytes.find(placeholder);
+            if (offset == std::string::npos || m_bytes.find(placeholder, offset + 1) != std::string::npos)
+                throw std::invalid_argument("template slot must appear exactly once: " + std::string(name));
+            m_slots.push_back(slot_at{offset, placeholder.size(), index++});
+        }
+        std::sort(m_slots.begin(), m_slots.end(), [](const slot_at &a, const slot_at &b)
+        {
+            return a.offset < b.offset;
+        });
+    }
+
+    void message_template::render(std::string &out, std::initializer_list<int64_t> values) const
+    {
+        out.reserve(out.size() + m_bytes.size() + m_slots.size() * 20);
+        size_t at = 0;
+        for (const slot_at &s : m_slots)
+        {
+            out.append(m_bytes, at, s.offset - at);
+            int64_t value = s.index < values.size() ? values.begin()[s.index] : 0;
+            if (m_format == MSGPACK)
+                msgpack::pack_integer(value, out);
+            else
+                detail::dump_number(value, out);
+            at = s.offset + s.length;
+        }
+        out.append(m_bytes, at, std::string::npos);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef UTIL_JSON_TEMPLATE_HPP
+#define UTIL_JSON_TEMPLATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/JSON.hpp>
+
+// A fixed-shape message serialized once, with integer slots filled in per message. render() copies the
+// bytes between slots and formats only the slot values, so it writes exactly what dump() or
+// msgpack::pack() would give for the same value, at the cost of a memcpy and a few integer formats.
+namespace json
+{
+    class message_template
+    {
+    public:
+        enum encoding
+        {
+            TEXT, MSGPACK
+        };
+
+        // Values in shape equal to slot(name) become slots; render() takes one value per name, in the
+        // order given here. Throws std::invalid_argument if a name does not appear exactly once.
+        message_template(const JSON &shape, std::initializer_list<std::string_view> names,
+                         encoding format = TEXT);
+
+        static JSON slot(std::string_view name);
+
+        size_t slot_count() const
+        {
+            return m_slots.size();
+        }
+
+        // Appends the message to out. Missing values render as 0.
+        void render(std::string &out, std::initializer_list<int64_t> values) const;
+
+    private:
+        struct slot_at
+        {
+            size_t offset;
+            size_t length;
+            size_t index;
+        };
+
+        encoding m_format;
+        std::string m_bytes;
+        std::vector<slot_at> m_slots;
+    };
+}
+
+#endif //UTIL_JSON_TEMPLATE_HPP
@@ -0,0 +1,270 @@
+#include "json_view.hpp"
+#include "json_detail.hpp"
+#include "json_simd.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace json
+{
+    static inline bool is_whitespace(char ch)
+    {
+        return ch == ' ' || ch == '\r' || ch == '\n' || ch == '\t';
+    }
+
+    document::document(std::string_view in) : m_in(in), m_valid(false)
+    {
+        if (in.empty() || in.size() >= std::numeric_limits<uint32_t>::max())
+            return;
+
+        simd::structural_index(in.data(), in.size(), m_index);
+        m_close.assign(m_index.size(), 0);
+
+        std::vector<uint32_t> open;
+        for (uint32_t k = 0; k < m_index.size(); k++)
+        {
+            char ch = at(k);
+            if (ch == '{' || ch == '[')
+            {
+                open.push_back(k);
+            }
+            else if (ch == '}' || ch == ']')
+            {
+                if (open.empty() || at(open.back()) != (ch == '}' ? '{' : '['))
+                    return;
+                m_close[open.back()] = k;
+                open.pop_back();
+            }
+            else if (ch == '"')
+            {
+                // Nothing inside a string is indexed, so an opening quote is always followed by its closing one.
+                if (k + 1 == m_index.size() || at(k + 1) != '"')
+                    return;
+                k++;
+            }
+        }
+        m_valid = open.empty() && !m_index.empty() && next(0) == m_index.size();
+    }
+
+    view document::root() const
+    {
+        return m_valid ? view(this, 0) : view();
+    }
+
+    uint32_t document::next(uint32_t k) const
+    {
+        char ch = at(k);
+        if (ch == '{' || ch == '[')
+            return m_close[k] + 1;
+        if (ch == '"')
+            return k + 2;
+        return k + 1;
+    }
+
+    size_t document::token_end(uint32_t k) const
+    {
+        size_t end = k + 1 < m_index.size() ? m_index[k + 1] : m_in.size();
+        while (end > m_index[k] && is_whitespace(m_in[end - 1]))
+            end--;
+        return end;
+    }
+
+    JSON::json_type view::type() const
+    {
+        if (m_doc == nullptr)
+            return JSON::NUL;
+
+        switch (m_doc->at(m_k))
+        {
+            case '{':
+                return JSON::OBJECT;
+            case '[':
+                return JSON::ARRAY;
+            case '"':
+                return JSON::STRING;
+            case 't':
+            case 'f':
+                return JSON::BOOL;
+            case 'n':
+                return JSON::NUL;
+            default:
+                return JSON::NUMBER;
+        }
+    }
+
+    view view::operator[](std::string_view key) const
+    {
+        if (!is_object())
+            return view();
+
+        // Keep scanning after a match: JSON::parse lets the last duplicate key win, and so does a view.
+        view found;
+        uint32_t close = m_doc->m_close[m_k];
+        uint32_t j = m_k + 1;
+        while (j < close && m_doc->at(j) == '"' && j + 3 < close && m_doc->at(j + 2) == ':')
+        {
+            if (view(m_doc, j).string_equals(key))
+                found = view(m_doc, j + 3);
+            j = m_doc->next(j + 3);
+            if (j < close && m_doc->at(j) == ',')
+                j++;
+        }
+        return found;
+    }
+
+    view view::operator[](size_t i) const
+    {
+        if (!is_array())
+            return view();
+
+        uint32_t close = m_doc->m_close[m_k];
+        uint32_t j = m_k + 1;
+        for (size_t n = 0; j < close; n++)
+        {
+            if (n == i)
+                return view(m_doc, j);
+            j = m_doc->next(j);
+            if (j < close && m_doc->at(j) == ',')
+                j++;
+        }
+        return view();
+    }
+
+    std::vector<view> view::elements() const
+    {
+        std::vector<view> items;
+        if (!is_array())
+            return items;
+
+        uint32_t close = m_doc->m_close[m_k];
+        uint32_t j = m_k + 1;
+        while (j < close)
+        {
+            items.push_back(view(m_doc, j));
+            j = m_doc->next(j);
+            if (j < close && m_doc->at(j) == ',')
+                j++;
+        }
+        return items;
+    }
+
+    size_t view::size() const
+    {
+        if (!is_object() && !is_array())
+            return 0;
+
+        size_t n = 0;
+        uint32_t close = m_doc->m_close[m_k];
+        uint32_t j = m_k + 1;
+        while (j < close)
+        {
+            j = m_doc->next(is_object() ? j + 3 : j);
+            if (j < close && m_doc->at(j) == ',')
+                j++;
+            n++;
+        }
+        return n;
+    }
+
+    std::string_view view::raw() const
+    {
+        if (m_doc == nullptr)
+            return std::string_view();
+
+        size_t begin = m_doc->m_index[m_k];
+        size_t end;
+        switch (m_doc->at(m_k))
+        {
+            case '{':
+            case '[':
+                end = m_doc->m_index[m_doc->m_close[m_k]] + 1;
+                break;
+            case '"':
+                end = m_doc->m_index[m_k + 1] + 1;
+                break;
+            default:
+                end = m_doc->token_end(m_k);
+                break;
+        }
+        return m_doc->m_in.substr(begin, end - begin);
+    }
+
+    std::string_view view::string_raw() const
+    {
+        if (!is_string())
+            return std::string_view();
+
+        size_t begin = m_doc->m_index[m_k] + 1;
+        return m_doc->m_in.substr(begin, m_doc->m_index[m_k + 1] - begin);
+    }
+
+    std::string view::string_value() const
+    {
+        std::string_view body = string_raw();
+        if (simd::find_string_special(body.data(), body.size()) == body.size())
+            return std::string(body);
+
+        std::string err;
+        return JSON::parse(std::string(raw()), err).string_value();
+    }
+
+    bool view::string_equals(std::string_view str) const
+    {
+        if (!is_string())
+            return false;
+
+        std::string_view body = string_raw();
+        if (simd::find_string_special(body.data(), body.size()) == body.size())
+            return body == str;
+        return string_value() == str;
+    }
+
+    double view::number_value() const
+    {
+        if (!is_number())
+            return 0;
+
+        std::string_view token = raw();
+        detail::number value = detail::parse_number(token.data(), token.data() + token.size());
+        return value.is_integer ? static_cast<double>(value.integer) : value.real;
+    }
+
+    bool view::is_integer() const
+    {
+        if (!is_number())
+            return false;
+
+        std::string_view token = raw();
+        return detail::parse_number(token.data(), token.data() + token.size()).is_integer;
+    }
+
+    int view::int_value() const
+    {
+        return static_cast<int>(int64_value());
+    }
+
+    int64_t view::int64_value() const
+    {
+        if (!is_number())
+            return 0;
+
+        std::string_view token = raw();
+        detail::number value = detail::parse_number(token.data(), token.data() + token.size());
+        return value.is_integer ? value.integer : detail::truncate_int64(value.real);
+    }
+
+    bool view::bool_value() const
+    {
+        return is_bool() && raw() == "true";
+    }
+
+    JSON view::decode() const
+    {
+        if (m_doc == nullptr)
+            return JSON();
+
+        std::string err;
+        return JSON::parse(std::string(raw()), err);
+    }
+}
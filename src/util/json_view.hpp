@@ -0,0 +1,142 @@
+#ifndef UTIL_JSON_VIEW_HPP
+#define UTIL_JSON_VIEW_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/JSON.hpp>
+
+namespace json
+{
+    class view;
+
+    // Structural index over a JSON text that is read in place. Only bracket balance is checked up front;
+    // strings and numbers are validated when a view decodes them. The text must outlive the document and
+    // every view taken from it.
+    class document final
+    {
+    public:
+        explicit document(std::string_view in);
+
+        document(const document &) = delete;
+
+        document &operator=(const document &) = delete;
+
+        bool valid() const
+        {
+            return m_valid;
+        }
+
+        view root() const;
+
+    private:
+        friend class view;
+
+        uint32_t next(uint32_t k) const;
+
+        size_t token_end(uint32_t k) const;
+
+        char at(uint32_t k) const
+        {
+            return m_in[m_index[k]];
+        }
+
+        std::string_view m_in;
+        std::vector<uint32_t> m_index;
+        std::vector<uint32_t> m_close;
+        bool m_valid;
+    };
+
+    // Cheap handle to one value of a document. Member and element lookups skip over siblings without
+    // decoding them; a missing member is a view for which exists() is false and type() is NUL.
+    class view final
+    {
+    public:
+        view() : m_doc(nullptr), m_k(0)
+        {}
+
+        bool exists() const
+        {
+            return m_doc != nullptr;
+        }
+
+        JSON::json_type type() const;
+
+        bool is_null() const
+        {
+            return type() == JSON::NUL;
+        }
+
+        bool is_number() const
+        {
+            return type() == JSON::NUMBER;
+        }
+
+        // A number written without fraction or exponent that fits int64_t, so int64_value() is exact.
+        bool is_integer() const;
+
+        bool is_bool() const
+        {
+            return type() == JSON::BOOL;
+        }
+
+        bool is_string() const
+        {
+            return type() == JSON::STRING;
+        }
+
+        bool is_array() const
+        {
+            return type() == JSON::ARRAY;
+        }
+
+        bool is_object() const
+        {
+            return type() == JSON::OBJECT;
+        }
+
+        view operator[](std::string_view key) const;
+
+        view operator[](size_t i) const;
+
+        // Members as written in the input, so duplicate keys are counted separately.
+        size_t size() const;
+
+        // The elements of an array in one pass, rather than one scan per index.
+        std::vector<view> elements() const;
+
+        // The bytes of this value exactly as they appear in the input.
+        std::string_view raw() const;
+
+        // The body of a string between its quotes, escapes left as they are.
+        std::string_view string_raw() const;
+
+        std::string string_value() const;
+
+        bool string_equals(std::string_view str) const;
+
+        double number_value() const;
+
+        int int_value() const;
+
+        int64_t int64_value() const;
+
+        bool bool_value() const;
+
+        // Materializes this subtree; the only place a view allocates JSON nodes.
+        JSON decode() const;
+
+    private:
+        friend class document;
+
+        view(const document *doc, uint32_t k) : m_doc(doc), m_k(k)
+        {}
+
+        const document *m_doc;
+        uint32_t m_k;
+    };
+}
+
+#endif //UTIL_JSON_VIEW_HPP
@@ -0,0 +1,160 @@
+#include "payload_id.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+namespace payload_id
+{
+    static const uint32_t s_slot_count = 1u << slot_bits;
+    static const uint32_t s_sequence_max = (1u << sequence_bits) - 1;
+
+    // The top slot is shared by threads that found every other slot taken; it is served by a CAS loop.
+    static const uint32_t s_shared_slot = s_slot_count - 1;
+
+    static uint32_t default_node()
+    {
+        uint32_t h = static_cast<uint32_t>(getpid()) * 0x9e3779b1u;
+        return (h >> (32 - node_bits)) & ((1u << node_bits) - 1);
+    }
+
+    static std::atomic<uint32_t> s_node(default_node());
+    static std::atomic<uint32_t> s_free_slots((1u << s_shared_slot) - 1);
+    static std::atomic<int64_t> s_shared_last(0);
+
+    // Last millisecond used through each slot, so a thread that inherits a slot never repeats an id its
+    // previous owner gave out ahead of the clock.
+    static std::atomic<int64_t> s_slot_last_ms[s_slot_count];
+
+    static int64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() - epoch_ms;
+    }
+
+    static int64_t compose(int64_t ms, uint32_t slot, uint32_t sequence)
+    {
+        return (ms << (node_bits + slot_bits + sequence_bits))
+               | (static_cast<int64_t>(s_node.load(std::memory_order_relaxed)) << (slot_bits + sequence_bits))
+               | (static_cast<int64_t>(slot) << sequence_bits) | sequence;
+    }
+
+    static uint32_t acquire_slot()
+    {
+        uint32_t free = s_free_slots.load(std::memory_order_relaxed);
+        while (free != 0)
+        {
+            uint32_t bit = free & (0u - free);
+            if (s_free_slots.compare_exchange_weak(free, free & ~bit, std::memory_order_acquire))
+                return static_cast<uint32_t>(__builtin_ctz(bit));
+        }
+        return s_shared_slot;
+    }
+
+    namespace
+    {
+        struct thread_state
+        {
+            thread_state() : slot(acquire_slot()), last_ms(0), sequence(s_sequence_max)
+            {
+                if (slot != s_shared_slot)
+                    last_ms = s_slot_last_ms[slot].load(std::memory_order_relaxed);
+            }
+
+            ~thread_state()
+            {
+                if (slot == s_shared_slot)
+                    return;
+                s_slot_last_ms[slot].store(last_ms, std::memory_order_relaxed);
+                s_free_slots.fetch_or(1u << slot, std::memory_order_release);
+            }
+
+            uint32_t slot;
+            int64_t last_ms;
+            uint32_t sequence;
+        };
+    }
+
+    static int64_t next_shared(int64_t ms)
+    {
+        int64_t last = s_shared_last.load(std::memory_order_relaxed);
+        int64_t id;
+        do
+        {
+            int64_t last_ms = last >> (node_bits + slot_bits + sequence_bits);
+            if (ms > last_ms)
+                id = compose(ms, s_shared_slot, 0);
+            else if ((last & s_sequence_max) == s_sequence_max)
+                id = compose(last_ms + 1, s_shared_slot, 0);
+            else
+                id = last + 1;
+        } while (!s_shared_last.compare_exchange_weak(last, id, std::memory_order_relaxed));
+        return id;
+    }
+
+    void set_node(uint32_t node)
+    {
+        s_node.store(node & ((1u << node_bits) - 1), std::memory_order_relaxed);
+    }
+
+    uint32_t node()
+    {
+        return s_node.load(std::memory_order_relaxed);
+    }
+
+    int64_t next()
+    {
+        thread_local thread_state state;
+        int64_t ms = now_ms();
+        if (state.slot == s_shared_slot)
+            return next_shared(ms);
+
+        if (ms > state.last_ms)
+        {
+            state.last_ms = ms;
+            state.sequence = 0;
+        }
+        else if (state.sequence < s_sequence_max)
+        {
+            state.sequence++;
+        }
+        else
+        {
+            state.last_ms++;
+            state.sequence = 0;
+        }
+        return compose(state.last_ms, state.slot, state.sequence);
+    }
+
+    int64_t time_ms(int64_t id)
+    {
+        return (id >> (node_bits + slot_bits + sequence_bits)) + epoch_ms;
+    }
+
+    bool configure_from_env()
+    {
+        const char *str_node = getenv("NUBILUM_NODE_ID");
+        if (str_node != nullptr && *str_node != '\0')
+        {
+            // set_node() keeps only the low bits, so anything that does not fit would quietly become
+            // another node's id.
+            char *end = nullptr;
+            errno = 0;
+            unsigned long value = strtoul(str_node, &end, 10);
+            if (*str_node < '0' || *str_node > '9' || *end != '\0' || errno != 0 || value >= (1ul << node_bits))
+            {
+                std::cerr << "NUBILUM_NODE_ID must be a node id from 0 to " << (1u << node_bits) - 1 << ", not '"
+                          << str_node << "'." << std::endl;
+                return false;
+            }
+            set_node(static_cast<uint32_t>(value));
+            return true;
+        }
+        std::cerr << "NUBILUM_NODE_ID is not set; using node " << node()
+                  << " from the process id, which another process may share." << std::endl;
+        return true;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef UTIL_PAYLOAD_ID_HPP
+#define UTIL_PAYLOAD_ID_HPP
+
+#include <cstdint>
+
+// Snowflake-style payload ids: milliseconds since 2024-01-01 UTC, then the node id, a per-thread slot and
+// a per-thread sequence. Ids are positive, unique across threads and across nodes with distinct node ids,
+// and ordered by creation time to the millisecond, so they can double as store offsets.
+namespace payload_id
+{
+    const int sequence_bits = 9;
+    const int slot_bits = 5;
+    const int node_bits = 8;
+    const int64_t epoch_ms = 1704067200000;
+
+    // Takes the low node_bits bits. Set it before ids are handed out. The default is derived from the
+    // process id, which keeps processes on one host apart most of the time but guarantees nothing: two
+    // processes share a node 1 time in 256, and their ids can then collide.
+    void set_node(uint32_t node);
+
+    uint32_t node();
+
+    // Lock-free. A thread that outruns the sequence borrows the next millisecond rather than waiting.
+    int64_t next();
+
+    // Milliseconds since the Unix epoch at which id was made.
+    int64_t time_ms(int64_t id);
+
+    // NUBILUM_NODE_ID sets the node id. Without it the process id default is kept and a warning printed; a
+    // value that is not a node id is an error, printed, and false is returned.
+    bool configure_from_env();
+}
+
+#endif //UTIL_PAYLOAD_ID_HPP
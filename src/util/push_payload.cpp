@@ -3,72 +3,248 @@
 #include <ctime>
 #include <iostream>
 #include <util/JSON.hpp>
+#include <util/json_arena.hpp>
+#include <util/json_template.hpp>
+#include <util/payload_id.hpp>
 
-push_payload::push_payload(std::string str)
+push_payload::push_payload(std::string str) :
+        m_id(0), m_importance(0), m_notify(false), m_timestamp(0), m_traced(false)
 {
-    std::string err;
-    m_json = json::JSON::parse(str, err);
+    json::read(str, *this);
+    m_traced = m_trace.has_value();
 }
 
-push_payload::push_payload(json::JSON::object obj) : m_json(obj)
+push_payload::push_payload(json::JSON::object obj) :
+        m_id(0), m_importance(0), m_notify(false), m_timestamp(0), m_traced(false)
 {
-    std::cout << m_json.dump() << std::endl;
+    std::string text = json::JSON(std::move(obj)).dump();
+    std::cout << text << std::endl;
+    json::read(text, *this);
+    m_traced = m_trace.has_value();
 }
 
-push_payload::push_payload(std::string header, int importance, json::JSON content, bool notify)
+static int64_t next_id()
 {
-    srand(time(NULL));
-    m_json = json::JSON::object{
-            {"id",        rand()},
-            {"header",     header},
-            {"importance", importance},
-            {"content",    content},
-            {"timestamp",  static_cast<int> (std::time(0))},
-            {"notify",     false}
-    };
+    return payload_id::next();
+}
+
+push_payload::push_payload(std::string header, int importance, json::JSON content, bool notify) :
+        m_content(std::move(content)), m_header(std::move(header)), m_id(next_id()), m_importance(importance),
+        m_notify(notify), m_timestamp(static_cast<int64_t> (std::time(0))), m_traced(false)
+{
+}
+
+int64_t push_payload::get_id() const
+{
+    return m_id;
+}
+
+const std::string &push_payload::get_header() const
+{
+    return m_header;
+}
+
+int push_payload::get_importance() const
+{
+    return m_importance;
+}
+
+const json::JSON &push_payload::get_content() const
+{
+    return m_content.get();
+}
+
+int64_t push_payload::get_timestamp() const
+{
+    return m_timestamp;
+}
+
+bool push_payload::should_notify() const
+{
+    return m_notify;
+}
+
+const std::string &push_payload::get_collapse_key() const
+{
+    static const std::string none;
+    return m_collapse_key ? *m_collapse_key : none;
+}
+
+int64_t push_payload::get_deliver_at() const
+{
+    return m_deliver_at ? *m_deliver_at : 0;
+}
+
+void push_payload::set_id(int64_t id)
+{
+    m_id = id;
+}
+
+void push_payload::set_header(std::string header)
+{
+    m_header = std::move(header);
+}
+
+void push_payload::set_importance(int importance)
+{
+    m_importance = importance;
+}
+
+void push_payload::set_content(json::JSON content)
+{
+    m_content = std::move(content);
+}
+
+json::JSON &push_payload::mutable_content()
+{
+    return m_content.get_mutable();
+}
 
+void push_payload::set_timestamp(int64_t timestamp)
+{
+    m_timestamp = timestamp;
+}
 
+void push_payload::set_notify(bool notify)
+{
+    m_notify = notify;
 }
 
-int push_payload::get_id()
+void push_payload::set_collapse_key(std::string key)
 {
-    return m_json["id"].int_value();
+    if (key.empty())
+        m_collapse_key.reset();
+    else
+        m_collapse_key = std::move(key);
 }
 
-std::string push_payload::get_header()
+void push_payload::set_deliver_at(int64_t deliver_at_ms)
 {
-    return m_json["header"].string_value();
+    if (deliver_at_ms == 0)
+        m_deliver_at.reset();
+    else
+        m_deliver_at = deliver_at_ms;
 }
 
-int push_payload::get_importance()
+void push_payload::renew()
 {
-    return m_json["importance"].int_value();
+    m_id = next_id();
+    m_timestamp = static_cast<int64_t> (std::time(0));
 }
 
-json::JSON push_payload::get_content()
+std::string push_payload::to_str() const
 {
-    return m_json["content"];
+    return json::write(*this);
 }
 
-int push_payload::get_timestamp()
+bool push_payload::is_traced() const
 {
-    return m_json["timestamp"].int_value();
+    return m_traced;
 }
 
-bool push_payload::should_notify()
+void push_payload::stamp(trace::hop at)
 {
-    return m_json["notify"].bool_value();
+    if (at == trace::CLIENT_SEND && !m_traced)
+        m_traced = trace::sample();
+    if (m_traced)
+        stamp(at, trace::mono_ns(), trace::wall_ns());
 }
 
-std::string push_payload::to_str()
+void push_payload::stamp(trace::hop at, uint64_t mono_ns, uint64_t wall_ns)
 {
-    return m_json.dump();
+    if (at == trace::CLIENT_SEND && !m_traced)
+        m_traced = trace::sample();
+    if (!m_traced)
+        return;
+
+    uint64_t trace_id = static_cast<uint64_t>(m_id);
+    if (at == trace::CLIENT_SEND)
+    {
+        // The sender's stamps travel with the payload so the server can record the first hop.
+        m_trace = trace_context{static_cast<int64_t>(mono_ns), static_cast<int64_t>(wall_ns)};
+    }
+    else if (at == trace::SERVER_RECV)
+    {
+        trace_context context = m_trace.value_or(trace_context());
+        trace::write({trace_id, trace::CLIENT_SEND, 0, 0, static_cast<uint64_t>(context.wall)});
+    }
+    trace::write({trace_id, at, 0, mono_ns, wall_ns});
 }
 
-push_payload acknowledge(push_payload incoming)
+push_payload acknowledge(const push_payload &incoming)
 {
     return push_payload("ack", incoming.get_importance(), json::JSON::object{
             {"recv-id",        incoming.get_id()},
             {"recv-timestamp", incoming.get_timestamp()}
     }, false);
 }
+
+json::arena_json acknowledge(const json::view &incoming, json::arena &scratch, std::string_view codec)
+{
+    json::arena_json content = codec.empty() ? json::arena_json::object(scratch, {
+            {"recv-id",        incoming["id"].int64_value()},
+            {"recv-timestamp", incoming["timestamp"].int64_value()}
+    }) : json::arena_json::object(scratch, {
+            {"codec",          json::arena_json(scratch, codec)},
+            {"recv-id",        incoming["id"].int64_value()},
+            {"recv-timestamp", incoming["timestamp"].int64_value()}
+    });
+    return json::arena_json::object(scratch, {
+            {"id",         next_id()},
+            {"header",     json::arena_json(scratch, "ack")},
+            {"importance", incoming["importance"].int_value()},
+            {"content",    content},
+            {"timestamp",  static_cast<int64_t> (std::time(0))},
+            {"notify",     false}
+    });
+}
+
+static json::JSON ack_shape()
+{
+    using json::message_template;
+    return json::JSON::object{
+            {"id",         message_template::slot("id")},
+            {"header",     "ack"},
+            {"importance", message_template::slot("importance")},
+            {"content",    json::JSON::object{
+                    {"recv-id",        message_template::slot("recv-id")},
+                    {"recv-timestamp", message_template::slot("recv-timestamp")}
+            }},
+            {"timestamp",  message_template::slot("timestamp")},
+            {"notify",     false}
+    };
+}
+
+void acknowledge(const json::view &incoming, std::string &out, bool packed)
+{
+    static const json::message_template text(ack_shape(), {"id", "importance", "recv-id", "recv-timestamp",
+                                                           "timestamp"});
+    static const json::message_template binary(ack_shape(), {"id", "importance", "recv-id", "recv-timestamp",
+                                                             "timestamp"}, json::message_template::MSGPACK);
+    (packed ? binary : text).render(out, {
+            next_id(),
+            incoming["importance"].int_value(),
+            incoming["id"].int64_value(),
+            incoming["timestamp"].int64_value(),
+            static_cast<int64_t> (std::time(0))
+    });
+}
+
+payload_trace::payload_trace(const json::view &payload, uint64_t recv_mono_ns, uint64_t recv_wall_ns) :
+        m_traced(false), m_trace_id(0)
+{
+    json::view context = payload["trace"];
+    if (!context.is_object())
+        return;
+
+    m_traced = true;
+    m_trace_id = static_cast<uint64_t>(payload["id"].int64_value());
+    trace::write({m_trace_id, trace::CLIENT_SEND, 0, 0, static_cast<uint64_t>(context["wall"].int64_value())});
+    trace::write({m_trace_id, trace::SERVER_RECV, 0, recv_mono_ns, recv_wall_ns});
+}
+
+void payload_trace::stamp(trace::hop at)
+{
+    if (m_traced)
+        trace::write({m_trace_id, at, 0, trace::mono_ns(), trace::wall_ns()});
+}
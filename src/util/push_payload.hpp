@@ -1,8 +1,52 @@
 #ifndef UTIL_PUSH_PAYLOAD_HPP
 #define UTIL_PUSH_PAYLOAD_HPP
 
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
 #include <util/JSON.hpp>
+#include <util/json_arena.hpp>
+#include <util/json_bind.hpp>
+#include <util/json_view.hpp>
+#include <util/trace.hpp>
+
+// What a client says about itself in its "idt" payload. codecs lists the wire encodings it can read
+// besides JSON text; the server names the one it picked in the ack. device is unique to one client and
+// kept across reconnects; the server keys retransmit detection and stored payloads on it.
+struct client_identity
+{
+    std::string device_class;
+    bool user = false;
+    std::vector<std::string> codecs;
+    std::string device;
+
+    static constexpr auto json_fields()
+    {
+        return std::make_tuple(json::field("class", &client_identity::device_class),
+                               json::field("codecs", &client_identity::codecs),
+                               json::field("device", &client_identity::device),
+                               json::field("user", &client_identity::user));
+    }
+};
+
+#define CODEC_MSGPACK "msgpack"
+
+// Sender-side stamps that travel with a traced payload. mono is the sender's own steady clock and is not
+// recorded by the server.
+struct trace_context
+{
+    int64_t mono = 0;
+    int64_t wall = 0;
+
+    static constexpr auto json_fields()
+    {
+        return std::make_tuple(json::field("mono", &trace_context::mono),
+                               json::field("wall", &trace_context::wall));
+    }
+};
 
 class push_payload
 {
@@ -13,24 +57,105 @@ public:
 
     push_payload(std::string header, int importance, json::JSON content, bool notify);
 
-    int get_id();
+    int64_t get_id() const;
+
+    const std::string &get_header() const;
+
+    int get_importance() const;
+
+    // Content read from text stays undecoded until first asked for.
+    const json::JSON &get_content() const;
+
+    int64_t get_timestamp() const;
+
+    bool should_notify() const;
+
+    // Empty unless set. A newer payload with the same key replaces this one while it waits for delivery.
+    const std::string &get_collapse_key() const;
+
+    // Wall-clock milliseconds since the Unix epoch before which the server holds the payload back, or 0 to
+    // deliver it at once.
+    int64_t get_deliver_at() const;
+
+    // Setters change only their own field, so a payload can be re-stamped or forwarded without rebuilding
+    // it. Content can be patched in place through mutable_content(), which copies it only if shared.
+    void set_id(int64_t id);
 
-    std::string get_header();
+    void set_header(std::string header);
 
-    int get_importance();
+    void set_importance(int importance);
 
-    json::JSON get_content();
+    void set_content(json::JSON content);
 
-    int get_timestamp();
+    json::JSON &mutable_content();
 
-    bool should_notify();
+    void set_timestamp(int64_t timestamp);
 
-    std::string to_str();
+    void set_notify(bool notify);
+
+    void set_collapse_key(std::string key);
+
+    void set_deliver_at(int64_t deliver_at_ms);
+
+    // A fresh id and timestamp, as when the payload is sent again.
+    void renew();
+
+    std::string to_str() const;
+
+    bool is_traced() const;
+
+    void stamp(trace::hop at);
+
+    void stamp(trace::hop at, uint64_t mono_ns, uint64_t wall_ns);
+
+    // Listed by name, so to_str() writes the same bytes JSON::dump did.
+    static constexpr auto json_fields()
+    {
+        return std::make_tuple(json::field("collapse", &push_payload::m_collapse_key),
+                               json::field("content", &push_payload::m_content),
+                               json::field("deliver-at", &push_payload::m_deliver_at),
+                               json::field("header", &push_payload::m_header),
+                               json::field("id", &push_payload::m_id),
+                               json::field("importance", &push_payload::m_importance),
+                               json::field("notify", &push_payload::m_notify),
+                               json::field("timestamp", &push_payload::m_timestamp),
+                               json::field("trace", &push_payload::m_trace));
+    }
 
 private:
-    json::JSON m_json;
+    std::optional<std::string> m_collapse_key;
+    json::lazy_json m_content;
+    std::optional<int64_t> m_deliver_at;
+    std::string m_header;
+    int64_t m_id;
+    int m_importance;
+    bool m_notify;
+    int64_t m_timestamp;
+    std::optional<trace_context> m_trace;
+    bool m_traced;
 };
 
-push_payload acknowledge(push_payload incoming);
+// Hop recorder for a payload that is routed straight from a json::view instead of a push_payload.
+class payload_trace
+{
+public:
+    payload_trace(const json::view &payload, uint64_t recv_mono_ns, uint64_t recv_wall_ns);
+
+    void stamp(trace::hop at);
+
+private:
+    bool m_traced;
+    uint64_t m_trace_id;
+};
+
+push_payload acknowledge(const push_payload &incoming);
+
+// Same ack, built in a caller-owned arena so the server can answer without touching the heap per node.
+// A non-empty codec is announced in the content, as the answer to an idt.
+json::arena_json acknowledge(const json::view &incoming, json::arena &scratch, std::string_view codec = {});
+
+// The same ack without a codec, rendered from a template serialized once and appended to out as text or
+// MessagePack. Byte for byte what dumping or packing the arena ack gives.
+void acknowledge(const json::view &incoming, std::string &out, bool packed);
 
 #endif //UTIL_PUSH_PAYLOAD_HPP
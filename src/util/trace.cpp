@@ -0,0 +1,102 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace trace
+{
+    static const char s_magic[8] = {'N', 'U', 'B', 'T', 'R', 'A', 'C', 'E'};
+    static const uint32_t s_version = 2;
+
+    static std::atomic<uint32_t> s_sample_interval(0);
+    static std::atomic<uint64_t> s_sample_counter(0);
+
+    static std::mutex s_mtx_file;
+    static FILE *s_file = nullptr;
+
+    uint64_t mono_ns()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    uint64_t wall_ns()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    void set_sample_interval(const uint32_t every_n)
+    {
+        s_sample_interval = every_n;
+    }
+
+    bool sample()
+    {
+        uint32_t every_n = s_sample_interval.load(std::memory_order_relaxed);
+        if (every_n == 0)
+            return false;
+        return s_sample_counter.fetch_add(1, std::memory_order_relaxed) % every_n == 0;
+    }
+
+    bool open(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(s_mtx_file);
+        if (s_file != nullptr)
+            fclose(s_file);
+
+        s_file = fopen(path.c_str(), "wb");
+        if (s_file == nullptr)
+            return false;
+
+        file_header header;
+        memcpy(header.magic, s_magic, sizeof(header.magic));
+        header.version = s_version;
+        header.record_size = sizeof(record);
+        fwrite(&header, sizeof(header), 1, s_file);
+        fflush(s_file);
+        return true;
+    }
+
+    bool is_open()
+    {
+        std::lock_guard<std::mutex> lock(s_mtx_file);
+        return s_file != nullptr;
+    }
+
+    void write(const record &rec)
+    {
+        std::lock_guard<std::mutex> lock(s_mtx_file);
+        if (s_file == nullptr)
+            return;
+
+        // Only sampled payloads reach this point, so flushing per record stays cheap and survives a kill.
+        fwrite(&rec, sizeof(rec), 1, s_file);
+        fflush(s_file);
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(s_mtx_file);
+        if (s_file != nullptr)
+        {
+            fclose(s_file);
+            s_file = nullptr;
+        }
+    }
+
+    void configure_from_env()
+    {
+        const char *str_interval = getenv("NUBILUM_TRACE_SAMPLE");
+        if (str_interval != nullptr)
+            set_sample_interval(static_cast<uint32_t>(strtoul(str_interval, nullptr, 10)));
+
+        const char *str_path = getenv("NUBILUM_TRACE_FILE");
+        if (str_path != nullptr && *str_path != '\0')
+            open(str_path);
+    }
+}
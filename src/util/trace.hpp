@@ -0,0 +1,52 @@
+#ifndef UTIL_TRACE_HPP
+#define UTIL_TRACE_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace trace
+{
+    enum hop : uint32_t
+    {
+        CLIENT_SEND, SERVER_RECV, DISPATCH, ENQUEUE, WRITE
+    };
+
+    // On-disk layout of a trace file: a file_header followed by packed records, host byte order.
+    struct file_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+    };
+
+    // The CLIENT_SEND record a server copies from a payload has mono_ns 0: the sender's steady clock has its
+    // own epoch, so only its wall_ns can be set against the server's hops.
+    struct record
+    {
+        uint64_t trace_id;
+        uint32_t hop;
+        uint32_t reserved;
+        uint64_t mono_ns;
+        uint64_t wall_ns;
+    };
+
+    uint64_t mono_ns();
+
+    uint64_t wall_ns();
+
+    void set_sample_interval(uint32_t every_n);
+
+    bool sample();
+
+    bool open(const std::string &path);
+
+    bool is_open();
+
+    void write(const record &rec);
+
+    void close();
+
+    void configure_from_env();
+}
+
+#endif //UTIL_TRACE_HPP